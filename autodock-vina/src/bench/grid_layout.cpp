@@ -0,0 +1,182 @@
+/*
+
+   Copyright (c) 2006-2010, The Scripps Research Institute
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+   Author: Dr. Oleg Trott <ot14@columbia.edu>, 
+           The Olson Lab, 
+           The Scripps Research Institute
+
+*/
+
+// Compares the grid layouts (array3d vs bricks, fl vs float) on the lookup pattern of cache::eval_deriv:
+// every movable atom of a ligand-sized cluster is evaluated in the map of its type, for poses drawn
+// uniformly over the box and for Monte Carlo like trajectories that move a pose by small steps, one
+// atom at a time or in batches of the same type (grid::evaluate with grid::batch_size locations)
+//
+// usage: vina-bench-grid-layout [evaluations per configuration]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include "grid.h"
+#include "random.h"
+
+namespace {
+
+const fl spacing = 0.375; // vina's default granularity
+const sz num_types = 4; // e.g. C, N, O, H-donor
+const sz num_atoms = 40;
+const fl ligand_radius = 6;
+
+grid_dims box(fl size) {
+	grid_dims gd;
+	VINA_FOR(i, 3) {
+		gd[i].n = sz(std::ceil(size / spacing));
+		gd[i].begin = -size / 2;
+		gd[i].end = gd[i].begin + gd[i].n * spacing;
+	}
+	return gd;
+}
+
+std::vector<grid> make_grids(const grid_dims& gd, bool single_precision, bool bricks) {
+	std::vector<grid> grids(num_types);
+	VINA_FOR(t, num_types) {
+		grid& g = grids[t];
+		g.init(gd);
+		VINA_FOR(z, g.dim(2))
+		VINA_FOR(y, g.dim(1))
+		VINA_FOR(x, g.dim(0))
+			g(x, y, z) = std::sin(0.1 * (t + 1) * x) * std::cos(0.07 * y) + 0.01 * z; // the values don't matter, the layout does
+		if(single_precision) g.to_single_precision();
+		if(bricks) g.to_bricks();
+	}
+	return grids;
+}
+
+struct pose {
+	vecv coords;
+	szv types;
+};
+
+pose random_pose(const grid_dims& gd, rng& generator) {
+	pose p;
+	const vec center = random_in_box(grid_dims_begin(gd) + vec(ligand_radius, ligand_radius, ligand_radius),
+	                                 grid_dims_end(gd)   - vec(ligand_radius, ligand_radius, ligand_radius), generator);
+	VINA_FOR(i, num_atoms) {
+		p.coords.push_back(center + ligand_radius * random_inside_sphere(generator));
+		p.types.push_back(random_sz(0, num_types - 1, generator));
+	}
+	return p;
+}
+
+void jitter(pose& p, rng& generator) { // a small rigid step, like a Monte Carlo move
+	const vec step = 0.2 * random_inside_sphere(generator);
+	VINA_FOR_IN(i, p.coords)
+		p.coords[i] += step;
+}
+
+fl run(const std::vector<grid>& grids, const std::vector<pose>& poses, bool local, bool batched, sz evaluations, double& ns_per_atom) {
+	rng generator(7);
+	fl e = 0;
+	vec deriv;
+	const sz steps = evaluations / num_atoms;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	pose p = poses.front();
+	VINA_FOR(s, steps) {
+		if(local) {
+			if(s % 100 == 0) p = poses[(s / 100) % poses.size()];
+			else jitter(p, generator);
+		}
+		const pose& q = local ? p : poses[s % poses.size()];
+		if(batched) { // grouped by type, like cache::eval_deriv
+			VINA_FOR(t, num_types) {
+				const vec* locations[grid::batch_size];
+				vec derivs[grid::batch_size];
+				vec* deriv_ptrs[grid::batch_size];
+				fl energies[grid::batch_size];
+				sz k = 0;
+				VINA_FOR_IN(i, q.coords) {
+					if(q.types[i] != t) continue;
+					locations[k] = &q.coords[i];
+					deriv_ptrs[k] = &derivs[k];
+					++k;
+					if(k == grid::batch_size || i + 1 == q.coords.size()) {
+						grids[t].evaluate(k, locations, 1e6, 1000, energies, deriv_ptrs);
+						VINA_FOR(j, k)
+							e += energies[j] + derivs[j][0] * 1e-9;
+						k = 0;
+					}
+				}
+				if(k > 0) {
+					grids[t].evaluate(k, locations, 1e6, 1000, energies, deriv_ptrs);
+					VINA_FOR(j, k)
+						e += energies[j] + derivs[j][0] * 1e-9;
+				}
+			}
+		}
+		else
+			VINA_FOR_IN(i, q.coords) {
+				e += grids[q.types[i]].evaluate(q.coords[i], 1e6, 1000, deriv);
+				e += deriv[0] * 1e-9;
+			}
+	}
+	const double elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+	ns_per_atom = elapsed / (steps * num_atoms);
+	return e;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+	const sz evaluations = (argc > 1) ? sz(std::atol(argv[1])) : 20000000;
+	const fl sizes[] = {20, 30, 40, 60};
+	std::cout << "batches use the " << (grid::simd ? "AVX2" : "scalar") << " kernel\n";
+	std::cout << "box (A)  map (MiB)  layout   precision  random (ns/atom)  local (ns/atom)  local batched (ns/atom)\n";
+	VINA_FOR(b, sizeof(sizes) / sizeof(sizes[0])) {
+		const grid_dims gd = box(sizes[b]);
+		rng generator(1);
+		std::vector<pose> poses;
+		VINA_FOR(i, 1000)
+			poses.push_back(random_pose(gd, generator));
+		VINA_FOR(layout, 2)
+		VINA_FOR(precision, 2) {
+			const bool bricks = (layout == 1);
+			const bool single_precision = (precision == 1);
+			const std::vector<grid> grids = make_grids(gd, single_precision, bricks);
+			double random_ns = max_fl, local_ns = max_fl, batched_ns = max_fl;
+			fl checksum = 0;
+			VINA_FOR(repetition, 3) { // best of, the machine is rarely quiet
+				double ns = 0;
+				checksum = run(grids, poses, false, false, evaluations, ns);
+				random_ns = (std::min)(random_ns, ns);
+				checksum += run(grids, poses, true, false, evaluations, ns);
+				local_ns = (std::min)(local_ns, ns);
+				run(grids, poses, true, true, evaluations, ns);
+				batched_ns = (std::min)(batched_ns, ns);
+			}
+			const double mib = double(grids[0].num_values() * grids[0].value_size()) / (1024 * 1024);
+			std::cout << std::fixed << std::setprecision(0) << std::setw(7) << sizes[b]
+			          << std::setprecision(2) << std::setw(11) << mib
+			          << "  " << std::setw(7) << (bricks ? "bricks" : "array3d")
+			          << "  " << std::setw(9) << (single_precision ? "float" : "double")
+			          << std::setw(18) << random_ns << std::setw(17) << local_ns << std::setw(25) << batched_ns
+			          << "   (" << std::setprecision(3) << checksum << ")\n";
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,135 @@
+/*
+
+   Copyright (c) 2006-2010, The Scripps Research Institute
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+   Author: Dr. Oleg Trott <ot14@columbia.edu>, 
+           The Olson Lab, 
+           The Scripps Research Institute
+
+*/
+
+// Counts the heap allocations of the Monte Carlo search, by replacing the global operator new: the
+// steps of monte_carlo (mutation and two local optimizations with a quasi_newton_workspace) should
+// not allocate once the workspace is sized, only saving a minimum to the output container does.
+//
+// usage: vina-bench-mc-allocations receptor.pdbqt ligand.pdbqt [steps] [lbfgs history]
+
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include "cache.h"
+#include "everything.h"
+#include "monte_carlo.h"
+#include "mutate.h"
+#include "parse_pdbqt.h"
+#include "quasi_newton.h"
+#include "weighted_terms.h"
+
+namespace {
+	sz allocations = 0;
+}
+
+void* operator new(std::size_t size) {
+	++allocations;
+	if(void* p = std::malloc(size ? size : 1))
+		return p;
+	throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+namespace {
+
+grid_dims box_around(const vecv& coords, fl size) {
+	vec center(0, 0, 0);
+	VINA_FOR_IN(i, coords)
+		center += coords[i];
+	center *= 1.0 / coords.size();
+	grid_dims gd;
+	VINA_FOR(i, 3) {
+		gd[i].n = sz(std::ceil(size / 0.375));
+		gd[i].begin = center[i] - size / 2;
+		gd[i].end = gd[i].begin + gd[i].n * 0.375;
+	}
+	return gd;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+	if(argc < 3) {
+		std::cerr << "usage: vina-bench-mc-allocations receptor.pdbqt ligand.pdbqt [steps] [lbfgs history]\n";
+		return 1;
+	}
+	const unsigned steps = (argc > 3) ? unsigned(std::atoi(argv[3])) : 1000;
+	const sz lbfgs_history = (argc > 4) ? sz(std::atoi(argv[4])) : 0;
+	model m = parse_receptor_pdbqt(path(argv[1]));
+	m.append(parse_ligand_pdbqt(path(argv[2])));
+
+	flv weights; // vina's defaults, see vina.cxx
+	weights.push_back(-0.0356);
+	weights.push_back(-0.00516);
+	weights.push_back(0.840);
+	weights.push_back(-0.0351);
+	weights.push_back(-0.587);
+	weights.push_back(5 * 0.0585 / 0.1 - 1);
+	everything t;
+	weighted_terms wt(&t, weights);
+	precalculate prec(wt);
+	const grid_dims gd = box_around(m.get_heavy_atom_movable_coords(), 20);
+	cache c("bench", gd, 1e6, atom_type::XS);
+	c.populate(m, prec, m.get_movable_atom_types(prec.atom_typing_used()), false);
+	const vec corner1(gd[0].begin, gd[1].begin, gd[2].begin);
+	const vec corner2(gd[0].end,   gd[1].end,   gd[2].end);
+
+	monte_carlo mc;
+	mc.num_steps = steps;
+	mc.ssd_par.evals = unsigned((25 + m.num_movable_atoms()) / 3);
+	mc.hunt_cap = vec(10, 10, 10);
+	mc.lbfgs_history = lbfgs_history;
+	rng generator(1);
+
+	// the body of a monte_carlo step, after a first step has sized the buffers
+	const conf_size s = m.get_size();
+	change g(s);
+	output_type current(s, 0);
+	current.c.randomize(corner1, corner2, generator);
+	output_type candidate = current;
+	quasi_newton quasi_newton_par; quasi_newton_par.max_steps = mc.ssd_par.evals; quasi_newton_par.lbfgs_history = lbfgs_history;
+	quasi_newton_workspace w = quasi_newton_par.workspace(current.c, g);
+	quasi_newton_par(m, prec, c, current, g, mc.hunt_cap, w);
+	const sz before_steps = allocations;
+	VINA_U_FOR(step, steps) {
+		candidate = current;
+		mutate_conf(candidate.c, m, mc.mutation_amplitude, generator);
+		quasi_newton_par(m, prec, c, candidate, g, mc.hunt_cap, w);
+		if(candidate.e < current.e)
+			current = candidate;
+	}
+	const sz step_allocations = allocations - before_steps;
+
+	// the whole search, including the setup and the saved minima
+	output_container out;
+	const sz before_search = allocations;
+	mc(m, out, prec, c, prec, c, corner1, corner2, NULL, generator);
+	const sz search_allocations = allocations - before_search;
+
+	std::cout << "steps: " << steps << ", movable atoms: " << m.num_movable_atoms() << ", degrees of freedom: " << s.num_degrees_of_freedom() << "\n"
+	          << "allocations in the steps (mutation and local optimization): " << step_allocations << "\n"
+	          << "allocations in monte_carlo: " << search_allocations << " (" << double(search_allocations) / steps << " per step, "
+	          << out.size() << " minima saved)\n";
+	return (step_allocations == 0) ? 0 : 1;
+}
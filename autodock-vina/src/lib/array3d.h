@@ -70,6 +70,8 @@ public:
 		m_k = k;
 		m_data.resize(checked_multiply(i, j, k));
 	}
+	T*       data()       { return m_data.empty() ? NULL : &m_data[0]; }
+	const T* data() const { return m_data.empty() ? NULL : &m_data[0]; }
 	T&       operator()(sz i, sz j, sz k)       { return m_data[i + m_i*(j + m_j*k)]; }
 	const T& operator()(sz i, sz j, sz k) const { return m_data[i + m_i*(j + m_j*k)]; }
 };
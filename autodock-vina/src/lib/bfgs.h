@@ -47,10 +47,10 @@ inline fl scalar_product(const Change& a, const Change& b, sz n) {
 }
 
 template<typename Change>
-inline bool bfgs_update(flmat& h, const Change& p, const Change& y, const fl alpha) {
+inline bool bfgs_update(flmat& h, const Change& p, const Change& y, const fl alpha, Change& minus_hy) { // minus_hy is scratch space, the size of y
 	const fl yp  = scalar_product(y, p, h.dim());
 	if(alpha * yp < epsilon_fl) return false; // FIXME?
-	Change minus_hy(y); minus_mat_vec_product(h, y, minus_hy);
+	minus_mat_vec_product(h, y, minus_hy);
 	const fl yhy = - scalar_product(y, minus_hy, h.dim());
 	const fl r = 1 / (alpha * yp); // 1 / (s^T * y) , where s = alpha * p // FIXME   ... < epsilon
 	const sz n = p.num_floats();
@@ -86,38 +86,65 @@ inline void set_diagonal(flmat& m, fl x) {
 		m(i, i) = x;
 }
 
+inline void set_identity(flmat& m) {
+	VINA_FOR(i, m.dim())
+		VINA_RANGE(j, i, m.dim())
+			m(i, j) = (i == j) ? 1 : 0;
+}
+
 template<typename Change>
 void subtract_change(Change& b, const Change& a, sz n) { // b -= a
 	VINA_FOR(i, n)
 		b(i) -= a(i);
 }
 
+// The buffers of bfgs, or of lbfgs when history > 0, sized after the first x and g. A minimization that
+// reuses a workspace doesn't allocate: conf and change keep their storage when they are assigned from one
+// of the same shape.
+template<typename Conf, typename Change>
+struct bfgs_workspace {
+	flmat h; // bfgs only
+	Conf x_new;
+	Conf x_orig;
+	Change g_new;
+	Change g_orig;
+	Change p;
+	Change y;
+	Change minus_hy;
+	std::vector<Change> s_history; // lbfgs only, the last corrections, a ring buffer
+	std::vector<Change> y_history;
+	flv rho;
+	flv a;
+	bfgs_workspace(const Conf& x, const Change& g, sz history = 0)
+		: h(history > 0 ? 0 : g.num_floats(), 0), x_new(x), x_orig(x), g_new(g), g_orig(g), p(g), y(g), minus_hy(g),
+		  s_history(history, g), y_history(history, g), rho(history, 0), a(history, 0) {}
+	sz history() const { return s_history.size(); }
+};
+
 template<typename F, typename Conf, typename Change>
-fl bfgs(F& f, Conf& x, Change& g, const unsigned max_steps, const fl average_required_improvement, const sz over) { // x is I/O, final value is returned
+fl bfgs(F& f, Conf& x, Change& g, bfgs_workspace<Conf, Change>& w, const unsigned max_steps, const fl average_required_improvement, const sz over) { // x is I/O, final value is returned
 	sz n = g.num_floats();
-	flmat h(n, 0);
-	set_diagonal(h, 1);
+	VINA_CHECK(w.h.dim() == n);
+	flmat& h = w.h;
+	set_identity(h);
 
-	Change g_new(g);
-	Conf x_new(x);
+	Change& g_new = w.g_new; g_new = g;
+	Conf& x_new = w.x_new; x_new = x;
 	fl f0 = f(x, g);
 
 	fl f_orig = f0;
-	Change g_orig(g);
-	Conf x_orig(x);
+	Change& g_orig = w.g_orig; g_orig = g;
+	Conf& x_orig = w.x_orig; x_orig = x;
 
-	Change p(g);
-
-	flv f_values; f_values.reserve(max_steps+1);
-	f_values.push_back(f0);
+	Change& p = w.p; p = g;
+	Change& y = w.y;
 
 	VINA_U_FOR(step, max_steps) {
 		minus_mat_vec_product(h, g, p);
 		fl f1 = 0;
 		const fl alpha = line_search(f, n, x, g, f0, p, x_new, g_new, f1);
-		Change y(g_new); subtract_change(y, g, n);
+		y = g_new; subtract_change(y, g, n);
 
-		f_values.push_back(f1);
 		f0 = f1;
 		x = x_new;
 		if(!(std::sqrt(scalar_product(g, g, n)) >= 1e-5)) break; // breaks for nans too // FIXME !!?? 
@@ -129,7 +156,92 @@ fl bfgs(F& f, Conf& x, Change& g, const unsigned max_steps, const fl average_req
 				set_diagonal(h, alpha * scalar_product(y, p, n) / yy);
 		}
 
-		bool h_updated = bfgs_update(h, p, y, alpha);
+		bool h_updated = bfgs_update(h, p, y, alpha, w.minus_hy);
+	}
+	if(!(f0 <= f_orig)) { // succeeds for nans too
+		f0 = f_orig;
+		x = x_orig;
+		g = g_orig;
+	}
+	return f0;
+}
+
+template<typename F, typename Conf, typename Change>
+fl bfgs(F& f, Conf& x, Change& g, const unsigned max_steps, const fl average_required_improvement, const sz over) { // x is I/O, final value is returned
+	bfgs_workspace<Conf, Change> w(x, g);
+	return bfgs(f, x, g, w, max_steps, average_required_improvement, over);
+}
+
+// p = -H g, with H the inverse hessian approximated from the stored corrections by the two-loop recursion,
+// scaled by gamma. newest is the ring buffer index of the latest correction.
+template<typename Conf, typename Change>
+void lbfgs_direction(bfgs_workspace<Conf, Change>& w, sz stored, sz newest, fl gamma, const Change& g, Change& p, sz n) {
+	const sz history = w.history();
+	p = g;
+	VINA_FOR(k, stored) {
+		const sz i = (newest + history - k) % history;
+		w.a[i] = w.rho[i] * scalar_product(w.s_history[i], p, n);
+		VINA_FOR(j, n)
+			p(j) -= w.a[i] * w.y_history[i](j);
+	}
+	VINA_FOR(j, n)
+		p(j) *= gamma;
+	VINA_FOR(k, stored) {
+		const sz i = (newest + history - (stored - 1 - k)) % history;
+		const fl b = w.rho[i] * scalar_product(w.y_history[i], p, n);
+		VINA_FOR(j, n)
+			p(j) += (w.a[i] - b) * w.s_history[i](j);
+	}
+	VINA_FOR(j, n)
+		p(j) = -p(j);
+}
+
+// Limited memory bfgs: the inverse hessian is kept as the last w.history() corrections instead of a dense
+// matrix, which costs O(n * history) per step instead of O(n^2). The line search, the stopping criterion
+// and the curvature condition are those of bfgs.
+template<typename F, typename Conf, typename Change>
+fl lbfgs(F& f, Conf& x, Change& g, bfgs_workspace<Conf, Change>& w, const unsigned max_steps, const fl average_required_improvement, const sz over) { // x is I/O, final value is returned
+	sz n = g.num_floats();
+	const sz history = w.history();
+	VINA_CHECK(history > 0);
+
+	Change& g_new = w.g_new; g_new = g;
+	Conf& x_new = w.x_new; x_new = x;
+	fl f0 = f(x, g);
+
+	fl f_orig = f0;
+	Change& g_orig = w.g_orig; g_orig = g;
+	Conf& x_orig = w.x_orig; x_orig = x;
+
+	Change& p = w.p;
+	Change& y = w.y;
+	sz stored = 0;
+	sz newest = history - 1;
+	fl gamma = 1; // the first step uses the identity, like bfgs
+
+	VINA_U_FOR(step, max_steps) {
+		lbfgs_direction(w, stored, newest, gamma, g, p, n);
+		fl f1 = 0;
+		const fl alpha = line_search(f, n, x, g, f0, p, x_new, g_new, f1);
+		y = g_new; subtract_change(y, g, n);
+
+		f0 = f1;
+		x = x_new;
+		if(!(std::sqrt(scalar_product(g, g, n)) >= 1e-5)) break; // breaks for nans too
+		g = g_new;
+
+		const fl yp = scalar_product(y, p, n);
+		if(alpha * yp < epsilon_fl) continue; // the update bfgs_update would skip
+		const fl yy = scalar_product(y, y, n);
+		if(std::abs(yy) > epsilon_fl)
+			gamma = alpha * yp / yy; // s^T y / y^T y of the latest correction
+		newest = (newest + 1) % history;
+		Change& s_new = w.s_history[newest];
+		VINA_FOR(j, n)
+			s_new(j) = alpha * p(j);
+		w.y_history[newest] = y;
+		w.rho[newest] = 1 / (alpha * yp);
+		if(stored < history) ++stored;
 	}
 	if(!(f0 <= f_orig)) { // succeeds for nans too
 		f0 = f_orig;
@@ -21,6 +21,7 @@
 */
 
 #include <algorithm> // fill, etc
+#include <cstring> // memcpy
 
 #if 0 // use binary cache
 	// for some reason, binary archive gives four huge warnings in VC2008
@@ -37,13 +38,18 @@
 
 #include <boost/serialization/split_member.hpp>
 #include <boost/filesystem/fstream.hpp>
+#include <boost/filesystem/operations.hpp> // rename
 #include <boost/static_assert.hpp>
+#include <boost/lexical_cast.hpp>
 #include "cache.h"
+#include "grid_map.h"
+#include "my_pid.h"
 #include "file.h"
 #include "szv_grid.h"
+#include "parallel.h"
 
-cache::cache(const std::string& scoring_function_version_, const grid_dims& gd_, fl slope_, atom_type::t atom_typing_used_) 
-: scoring_function_version(scoring_function_version_), gd(gd_), slope(slope_), atu(atom_typing_used_), grids(num_atom_types(atom_typing_used_)) {}
+cache::cache(const std::string& scoring_function_version_, const grid_dims& gd_, fl slope_, atom_type::t atom_typing_used_, bool single_precision_, bool bricks_) 
+: scoring_function_version(scoring_function_version_), gd(gd_), slope(slope_), atu(atom_typing_used_), single_precision(single_precision_), bricks(bricks_), grids(num_atom_types(atom_typing_used_)) {}
 
 fl cache::eval      (const model& m, fl v) const { // needs m.coords
 	fl e = 0;
@@ -61,35 +67,83 @@ fl cache::eval      (const model& m, fl v) const { // needs m.coords
 }
 
 fl cache::eval_deriv(      model& m, fl v) const { // needs m.coords, sets m.minus_forces
+	// The atoms are grouped by type into batches of grid::batch_size, which grid::evaluate interpolates together.
+	// The energies are summed in atom order afterwards, so that the result doesn't depend on the batching.
+	const sz window = 256; // atoms per pass, the buffers stay on the stack
+	const sz max_types = 32;
 	fl e = 0;
 	sz nat = num_atom_types(atu);
+	VINA_CHECK(nat <= max_types);
+	const sz n = m.num_movable_atoms();
 
-	VINA_FOR(i, m.num_movable_atoms()) {
-		const atom& a = m.atoms[i];
-		sz t = a.get(atu);
-		if(t >= nat) { m.minus_forces[i].assign(0); continue; }
-		const grid& g = grids[t];
-		assert(g.initialized());
-		vec deriv;
-		e += g.evaluate(m.coords[i], slope, v, deriv);
-		m.minus_forces[i] = deriv;
+	fl energies[window];
+	const vec* locations[max_types][grid::batch_size];
+	vec* derivs[max_types][grid::batch_size];
+	sz atoms[max_types][grid::batch_size];
+	sz pending[max_types];
+	fl batch_energies[grid::batch_size];
+
+	for(sz begin = 0; begin < n; begin += window) {
+		const sz end = (std::min)(n, begin + window);
+		std::fill(pending, pending + nat, 0);
+		for(sz i = begin; i < end; ++i) {
+			const atom& a = m.atoms[i];
+			sz t = a.get(atu);
+			if(t >= nat) { m.minus_forces[i].assign(0); energies[i - begin] = 0; continue; }
+			assert(grids[t].initialized());
+			sz& k = pending[t];
+			locations[t][k] = &m.coords[i];
+			derivs[t][k] = &m.minus_forces[i];
+			atoms[t][k] = i - begin;
+			if(++k == grid::batch_size) {
+				grids[t].evaluate(k, locations[t], slope, v, batch_energies, derivs[t]);
+				VINA_FOR(j, k)
+					energies[atoms[t][j]] = batch_energies[j];
+				k = 0;
+			}
+		}
+		VINA_FOR(t, nat) {
+			const sz k = pending[t];
+			if(k == 0) continue;
+			grids[t].evaluate(k, locations[t], slope, v, batch_energies, derivs[t]);
+			VINA_FOR(j, k)
+				energies[atoms[t][j]] = batch_energies[j];
+		}
+		for(sz i = begin; i < end; ++i)
+			if(m.atoms[i].get(atu) < nat)
+				e += energies[i - begin];
 	}
 	return e;
 }
 
-#if 0 // No longer doing I/O of the cache
-void cache::read(const path& p) {
-	ifile in(p, std::ios::binary);
-	iarchive ar(in);
-	ar >> *this;
+void cache::write(const path& p, const grid_map_key& key) const {
+	const grid_map_header h(scoring_function_version, gd, atu, grids.size(), value_size(), bricks, key);
+	path tmp = p;
+	tmp += "." + boost::lexical_cast<std::string>(my_pid()) + ".tmp"; // written aside and renamed, so that readers never see a partial file
+	{
+		ofile out(tmp, std::ios::binary);
+		out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+		std::vector<char> padding(grid_map_header_size - sizeof(h), 0);
+		out.write(&padding[0], padding.size());
+		VINA_FOR_IN(t, grids) {
+			const grid& g = grids[t];
+			VINA_CHECK(g.initialized());
+			VINA_CHECK(g.value_size() == value_size() && g.bricks() == bricks);
+			out.write(static_cast<const char*>(g.storage()), grid_size());
+		}
+		if(!out)
+			throw file_error(tmp, false);
+	}
+	boost::filesystem::rename(tmp, p);
 }
 
-void cache::write(const path& p) const {
-	ofile out(p, std::ios::binary);
-	oarchive ar(out);
-	ar << *this;
+void cache::attach(const grid_map& map, const grid_map_key& key) {
+	const grid_map_header& h = map.header();
+	if(scoring_function_version != h.scoring_function_version) throw energy_mismatch();
+	if(!eq(gd, h.dims()))                                     throw grid_dims_mismatch();
+	if(h.atom_typing != atu || h.num_types != grids.size() || h.value_size != value_size() || bool(h.bricks) != bricks || h.key != key.value) throw cache_mismatch();
+	attach(map.values());
 }
-#endif
 
 template<class Archive>
 void cache::save(Archive& ar, const unsigned version) const {
@@ -108,7 +162,104 @@ void cache::load(Archive& ar, const unsigned version) {
 	ar & grids;
 }
 
-void cache::populate(const model& m, const precalculate& p, const szv& atom_types_needed, bool display_progress) {
+sz cache::value_size() const {
+	return single_precision ? sizeof(float) : sizeof(fl);
+}
+
+sz cache::grid_size() const {
+	return checked_multiply(grid::num_values(gd, bricks), value_size());
+}
+
+sz cache::storage_size() const {
+	return checked_multiply(grids.size(), grid_size());
+}
+
+void cache::move_to(void* storage) {
+	const sz bytes = grid_size();
+	VINA_FOR_IN(t, grids) {
+		grid& g = grids[t];
+		if(!g.initialized()) continue;
+		VINA_CHECK(g.value_size() == value_size() && g.bricks() == bricks);
+		char* dst = static_cast<char*>(storage) + t * bytes;
+		if(g.storage() != dst)
+			std::memcpy(dst, g.storage(), bytes);
+		if(single_precision)
+			g.init(gd, reinterpret_cast<const float*>(dst), bricks);
+		else
+			g.init(gd, reinterpret_cast<const fl*>(dst), bricks);
+	}
+}
+
+void cache::attach(const void* storage) {
+	const sz bytes = grid_size();
+	VINA_FOR_IN(t, grids) {
+		const char* src = static_cast<const char*>(storage) + t * bytes;
+		if(single_precision)
+			grids[t].init(gd, reinterpret_cast<const float*>(src), bricks);
+		else
+			grids[t].init(gd, reinterpret_cast<const fl*>(src), bricks);
+	}
+}
+
+struct populate_aux { // fills one z-slab of the needed grids, so that threads write disjoint memory
+	const szv_grid* ig;
+	const grid* g;
+	std::vector<grid*> targets; // one per needed type
+	const flv* xs; // receptor atoms, SoA
+	const flv* ys;
+	const flv* zs;
+	const szv* types;
+	const flv* table; // [t1][bin][needed type], so that all needed types are accumulated together
+	sz num_bins;
+	fl factor;
+	fl cutoff_sqr;
+	void operator()(sz z) const {
+		const sz nn = targets.size();
+		flv affinities(nn);
+		flv bx, by, bz, r2; // the receptor atoms of the current szv_grid cell, SoA
+		szv bt;
+		const szv* cell = NULL;
+		VINA_FOR(y, g->dim(1)) {
+			VINA_FOR(x, g->dim(0)) {
+				vec probe_coords; probe_coords = g->index_to_argument(x, y, z);
+				const szv& possibilities = ig->possibilities(probe_coords);
+				if(&possibilities != cell) {
+					cell = &possibilities;
+					bx.clear(); by.clear(); bz.clear(); bt.clear();
+					VINA_FOR_IN(possibilities_i, possibilities) {
+						const sz i = possibilities[possibilities_i];
+						if((*types)[i] == max_sz) continue;
+						bx.push_back((*xs)[i]);
+						by.push_back((*ys)[i]);
+						bz.push_back((*zs)[i]);
+						bt.push_back((*types)[i]);
+					}
+					r2.resize(bt.size());
+				}
+				const sz na = bt.size();
+				const fl px = probe_coords[0];
+				const fl py = probe_coords[1];
+				const fl pz = probe_coords[2];
+				VINA_FOR(k, na) // vectorizes
+					r2[k] = sqr(bx[k] - px) + sqr(by[k] - py) + sqr(bz[k] - pz);
+				std::fill(affinities.begin(), affinities.end(), 0);
+				VINA_FOR(k, na) {
+					if(r2[k] <= cutoff_sqr) {
+						const sz bin = sz(factor * r2[k]);
+						assert(bin < num_bins);
+						const fl* row = &(*table)[(bt[k] * num_bins + bin) * nn];
+						VINA_FOR(j, nn) // vectorizes
+							affinities[j] += row[j];
+					}
+				}
+				VINA_FOR(j, nn)
+					(*targets[j])(x, y, z) = affinities[j];
+			}
+		}
+	}
+};
+
+void cache::populate(const model& m, const precalculate& p, const szv& atom_types_needed, bool display_progress, sz num_threads) {
 	szv needed;
 	VINA_FOR_IN(i, atom_types_needed) {
 		sz t = atom_types_needed[i];
@@ -119,7 +270,6 @@ void cache::populate(const model& m, const precalculate& p, const szv& atom_type
 	}
 	if(needed.empty())
 		return;
-	flv affinities(needed.size());
 
 	sz nat = num_atom_types(atu);
 
@@ -130,33 +280,56 @@ void cache::populate(const model& m, const precalculate& p, const szv& atom_type
 	grid_dims gd_reduced = szv_grid_dims(gd);
 	szv_grid ig(m, gd_reduced, cutoff_sqr);
 
-	VINA_FOR(x, g.m_data.dim0()) {
-		VINA_FOR(y, g.m_data.dim1()) {
-			VINA_FOR(z, g.m_data.dim2()) {
-				std::fill(affinities.begin(), affinities.end(), 0);
-				vec probe_coords; probe_coords = g.index_to_argument(x, y, z);
-				const szv& possibilities = ig.possibilities(probe_coords);
-				VINA_FOR_IN(possibilities_i, possibilities) {
-					const sz i = possibilities[possibilities_i];
-					const atom& a = m.grid_atoms[i];
-					const sz t1 = a.get(atu);
-					if(t1 >= nat) continue;
-					const fl r2 = vec_distance_sqr(a.coords, probe_coords);
-					if(r2 <= cutoff_sqr) {
-						VINA_FOR_IN(j, needed) {
-							const sz t2 = needed[j];
-							assert(t2 < nat);
-							const sz type_pair_index = triangular_matrix_index_permissive(num_atom_types(atu), t1, t2);
-							affinities[j] += p.eval_fast(type_pair_index, r2);
-						}
-					}
-				}
-				VINA_FOR_IN(j, needed) {
-					sz t = needed[j];
-					assert(t < nat);
-					grids[t].m_data(x, y, z) = affinities[j];
-				}
-			}
+	flv xs(m.grid_atoms.size()), ys(m.grid_atoms.size()), zs(m.grid_atoms.size());
+	szv types(m.grid_atoms.size());
+	VINA_FOR_IN(i, m.grid_atoms) {
+		const atom& a = m.grid_atoms[i];
+		const sz t1 = a.get(atu);
+		xs[i] = a.coords[0];
+		ys[i] = a.coords[1];
+		zs[i] = a.coords[2];
+		types[i] = (t1 < nat) ? t1 : max_sz;
+	}
+
+	const sz nn = needed.size();
+	const sz num_bins = p.element(0).fast.size();
+	flv table(nat * num_bins * nn, 0);
+	VINA_FOR(t1, nat)
+		VINA_FOR(j, nn) {
+			const sz t2 = needed[j];
+			assert(t2 < nat);
+			const flv& fast = p.element(triangular_matrix_index_permissive(nat, t1, t2)).fast;
+			VINA_CHECK(fast.size() == num_bins);
+			VINA_FOR(bin, num_bins)
+				table[(t1 * num_bins + bin) * nn + j] = fast[bin];
 		}
+
+	populate_aux aux;
+	aux.ig = &ig;
+	aux.g = &g;
+	VINA_FOR_IN(j, needed)
+		aux.targets.push_back(&grids[needed[j]]);
+	aux.xs = &xs;
+	aux.ys = &ys;
+	aux.zs = &zs;
+	aux.types = &types;
+	aux.table = &table;
+	aux.num_bins = num_bins;
+	aux.factor = p.element(0).factor;
+	aux.cutoff_sqr = cutoff_sqr;
+
+	if(num_threads > 1) {
+		parallel_for<populate_aux, true> pf(&aux, num_threads);
+		pf.run(g.dim(2));
+	}
+	else
+		VINA_FOR(z, g.dim(2))
+			aux(z);
+
+	VINA_FOR_IN(j, needed) {
+		if(single_precision) // populated in fl, so that the maps only differ from the fl ones by the final rounding
+			grids[needed[j]].to_single_precision();
+		if(bricks)
+			grids[needed[j]].to_bricks();
 	}
 }
@@ -28,26 +28,34 @@
 #include "grid.h"
 #include "model.h"
 
+struct grid_map;
+struct grid_map_key;
+
 struct cache_mismatch {};
 struct rigid_mismatch : public cache_mismatch {};
 struct grid_dims_mismatch : public cache_mismatch {};
 struct energy_mismatch : public cache_mismatch {};
 
 struct cache : public igrid {
-	cache(const std::string& scoring_function_version_, const grid_dims& gd_, fl slope_, atom_type::t atom_typing_used_);
+	cache(const std::string& scoring_function_version_, const grid_dims& gd_, fl slope_, atom_type::t atom_typing_used_, bool single_precision_ = false, bool bricks_ = false); // stores the grids as float and/or in bricks, see grid.h
 	fl eval      (const model& m, fl v) const; // needs m.coords // clean up
 	fl eval_deriv(      model& m, fl v) const; // needs m.coords, sets m.minus_forces // clean up
-#if 0 // no longer doing I/O of the cache
-	void read(const path& name); // can throw cache_mismatch
-	void write(const path& name) const;
-#endif
-	void populate(const model& m, const precalculate& p, const szv& atom_types_needed, bool display_progress = true);
+	void write(const path& name, const grid_map_key& key) const; // writes every grid into a grid map file, see grid_map.h
+	void populate(const model& m, const precalculate& p, const szv& atom_types_needed, bool display_progress = true, sz num_threads = 1);
+	sz value_size() const; // sizeof(float) or sizeof(fl)
+	sz storage_size() const; // number of bytes holding the grids of every atom type
+	sz grid_size() const; // number of bytes holding one grid
+	void move_to(void* storage); // copies the populated grids into storage, which must outlive the cache, and reads them from there
+	void attach(const void* storage); // reads the grids of every atom type from storage, populated elsewhere by move_to
+	void attach(const grid_map& map, const grid_map_key& key); // reads the grids from map, which must outlive the cache, can throw cache_mismatch
 private:
 	std::string scoring_function_version;
 	atomv atoms; // for verification
 	grid_dims gd;
 	fl slope; // does not get (de-)serialized
 	atom_type::t atu;
+	bool single_precision;
+	bool bricks;
 	std::vector<grid> grids;
 
 	friend class boost::serialization::access;
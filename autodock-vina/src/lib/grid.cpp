@@ -23,22 +23,162 @@
 #include "grid.h"
 
 void grid::init(const grid_dims& gd) {
+	m_view = NULL;
+	m_view_single = NULL;
+	std::vector<fl>().swap(m_data_bricks);
+	std::vector<float>().swap(m_data_single);
 	m_data.resize(gd[0].n+1, gd[1].n+1, gd[2].n+1);
+	init_geometry(gd, false);
+}
+
+void grid::init(const grid_dims& gd, const fl* storage, bool bricks) {
+	VINA_CHECK(storage);
+	m_view = storage;
+	m_view_single = NULL;
+	std::vector<fl>().swap(m_data_bricks);
+	std::vector<float>().swap(m_data_single);
+	m_data = array3d<fl>(); // releases the owned values
+	init_geometry(gd, bricks);
+}
+
+void grid::init(const grid_dims& gd, const float* storage, bool bricks) {
+	VINA_CHECK(storage);
+	m_view = NULL;
+	m_view_single = storage;
+	std::vector<fl>().swap(m_data_bricks);
+	std::vector<float>().swap(m_data_single);
+	m_data = array3d<fl>();
+	init_geometry(gd, bricks);
+}
+
+sz grid::num_values(const grid_dims& gd, bool bricks) {
+	if(!bricks)
+		return checked_multiply(gd[0].n+1, gd[1].n+1, gd[2].n+1);
+	const sz e = brick_edge - 1; // cells per brick edge
+	return checked_multiply(checked_multiply((gd[0].n + e - 1) / e, (gd[1].n + e - 1) / e, (gd[2].n + e - 1) / e), sz(brick_size));
+}
+
+sz grid::num_values() const {
+	if(!bricks())
+		return checked_multiply(m_dims[0], m_dims[1], m_dims[2]);
+	return checked_multiply(checked_multiply(m_bricks[0], m_bricks[1], m_bricks[2]), sz(brick_size));
+}
+
+void grid::to_single_precision() {
+	if(single_precision()) return;
+	const fl* values = data();
+	VINA_CHECK(values);
+	const sz n = num_values();
+	m_data_single.resize(n);
+	VINA_FOR(i, n)
+		m_data_single[i] = float(values[i]);
+	m_view = NULL;
+	std::vector<fl>().swap(m_data_bricks);
+	m_data = array3d<fl>();
+	m_view_single = &m_data_single[0];
+}
+
+template<typename T>
+void grid::to_bricks(const T* values, std::vector<T>& bricked) const {
+	const sz e = brick_edge - 1;
+	boost::array<sz, 3> nb;
+	VINA_FOR(i, 3)
+		nb[i] = (m_dims[i] - 1 + e - 1) / e;
+	bricked.assign(checked_multiply(checked_multiply(nb[0], nb[1], nb[2]), sz(brick_size)), 0); // points past the end of the map stay 0
+	VINA_FOR(bz, nb[2])
+	VINA_FOR(by, nb[1])
+	VINA_FOR(bx, nb[0]) {
+		T* dst = &bricked[brick_size * (bx + nb[0]*(by + nb[1]*bz))];
+		VINA_FOR(lz, brick_edge) {
+			const sz z = e * bz + lz;
+			if(z >= m_dims[2]) break;
+			VINA_FOR(ly, brick_edge) {
+				const sz y = e * by + ly;
+				if(y >= m_dims[1]) break;
+				VINA_FOR(lx, brick_edge) {
+					const sz x = e * bx + lx;
+					if(x >= m_dims[0]) break;
+					dst[lx + brick_edge*(ly + brick_edge*lz)] = values[x + m_dims[0]*(y + m_dims[1]*z)];
+				}
+			}
+		}
+	}
+}
+
+void grid::to_bricks() {
+	if(bricks()) return;
+	VINA_CHECK(initialized());
+	const sz e = brick_edge - 1;
+	if(single_precision()) {
+		std::vector<float> tmp;
+		to_bricks(m_view_single, tmp);
+		m_data_single.swap(tmp);
+		m_view_single = &m_data_single[0];
+	}
+	else {
+		to_bricks(data(), m_data_bricks);
+		m_data = array3d<fl>();
+		m_view = &m_data_bricks[0];
+	}
+	VINA_FOR(i, 3)
+		m_bricks[i] = (m_dims[i] - 1 + e - 1) / e;
+}
+
+void grid::init_geometry(const grid_dims& gd, bool bricks) {
+	const sz e = brick_edge - 1;
+	VINA_FOR(i, 3) {
+		m_dims[i] = gd[i].n+1;
+		m_bricks[i] = bricks ? (gd[i].n + e - 1) / e : 0;
+	}
 	m_init = vec(gd[0].begin, gd[1].begin, gd[2].begin);
 	m_range = vec(gd[0].span(), gd[1].span(), gd[2].span());
 	assert(m_range[0] > 0);
 	assert(m_range[1] > 0);
 	assert(m_range[2] > 0);
-	m_dim_fl_minus_1 = vec(m_data.dim0() - 1.0, 
-	                       m_data.dim1() - 1.0,
-			               m_data.dim2() - 1.0);
+	m_dim_fl_minus_1 = vec(m_dims[0] - 1.0, 
+	                       m_dims[1] - 1.0,
+			               m_dims[2] - 1.0);
 	VINA_FOR(i, 3) {
 		m_factor[i] = m_dim_fl_minus_1[i] / m_range[i];
 		m_factor_inv[i] = 1 / m_factor[i];
 	}
 }
 
+void grid::evaluate(sz n, const vec* const* locations, fl slope, fl v, fl* energies, vec* const* derivs) const {
+	assert(n <= batch_size);
+	if(simd && n > 1 && num_values() < (sz(1) << 31)) { // the kernel gathers with 32-bit indices
+		const vec* l[batch_size];
+		vec* d[batch_size];
+		fl e[batch_size];
+		vec unused[batch_size];
+		VINA_FOR(k, batch_size) { // pads the batch with the first location
+			l[k] = locations[(k < n) ? k : 0];
+			d[k] = (k < n) ? derivs[k] : &unused[k];
+		}
+		if(m_view_single) {
+			if(bricks()) evaluate_avx2<float, true >(m_view_single, l, slope, v, e, d);
+			else         evaluate_avx2<float, false>(m_view_single, l, slope, v, e, d);
+		}
+		else {
+			if(bricks()) evaluate_avx2<fl, true >(data(), l, slope, v, e, d);
+			else         evaluate_avx2<fl, false>(data(), l, slope, v, e, d);
+		}
+		VINA_FOR(k, n)
+			energies[k] = e[k];
+		return;
+	}
+	VINA_FOR(k, n)
+		energies[k] = evaluate_aux(*locations[k], slope, v, derivs[k]);
+}
+
 fl grid::evaluate_aux(const vec& location, fl slope, fl v, vec* deriv) const { // sets *deriv if not NULL
+	if(m_view_single)
+		return bricks() ? evaluate_aux<float, true>(m_view_single, location, slope, v, deriv) : evaluate_aux<float, false>(m_view_single, location, slope, v, deriv);
+	return bricks() ? evaluate_aux<fl, true>(data(), location, slope, v, deriv) : evaluate_aux<fl, false>(data(), location, slope, v, deriv);
+}
+
+template<typename T, bool Bricks>
+fl grid::evaluate_aux(const T* values, const vec& location, fl slope, fl v, vec* deriv) const { // values are widened to fl, so that the sums are accumulated in fl
 	vec s  = elementwise_product(location - m_init, m_factor); 
 
 	vec miss(0, 0, 0);
@@ -55,8 +195,8 @@ fl grid::evaluate_aux(const vec& location, fl slope, fl v, vec* deriv) const { /
 		else if(s[i] >= m_dim_fl_minus_1[i]) {
 			miss[i] = s[i] - m_dim_fl_minus_1[i];
 			region[i] = 1;
-			assert(m_data.dim(i) >= 2);
-			a[i] = m_data.dim(i) -  2; 
+			assert(m_dims[i] >= 2);
+			a[i] = m_dims[i] -  2; 
 			s[i] = 1;
 		}
 		else {
@@ -67,7 +207,7 @@ fl grid::evaluate_aux(const vec& location, fl slope, fl v, vec* deriv) const { /
 		assert(s[i] >= 0);
 		assert(s[i] <= 1);
 		assert(a[i] >= 0);
-		assert(a[i]+1 < m_data.dim(i));
+		assert(a[i]+1 < m_dims[i]);
 	}
 	const fl penalty = slope * (miss * m_factor_inv); // FIXME check that inv_factor is correctly initialized and serialized
 	assert(penalty > -epsilon_fl);
@@ -76,19 +216,28 @@ fl grid::evaluate_aux(const vec& location, fl slope, fl v, vec* deriv) const { /
 	const sz y0 = a[1];
 	const sz z0 = a[2];
 
-	const sz x1 = x0+1;
-	const sz y1 = y0+1;
-	const sz z1 = z0+1;
-
+	sz base, dy, dz; // of f000, and strides to the y1 and z1 corners
+	if(Bricks) {
+		const sz e = brick_edge - 1;
+		const sz bx = x0 / e, by = y0 / e, bz = z0 / e; // cells never straddle bricks
+		base = brick_size * (bx + m_bricks[0]*(by + m_bricks[1]*bz)) + (x0 - e*bx) + brick_edge*((y0 - e*by) + brick_edge*(z0 - e*bz));
+		dy = brick_edge;
+		dz = brick_edge * brick_edge;
+	}
+	else {
+		base = x0 + m_dims[0]*(y0 + m_dims[1]*z0);
+		dy = m_dims[0];
+		dz = m_dims[0] * m_dims[1];
+	}
 
-	const fl f000 = m_data(x0, y0, z0);
-	const fl f100 = m_data(x1, y0, z0);
-	const fl f010 = m_data(x0, y1, z0);
-	const fl f110 = m_data(x1, y1, z0);
-	const fl f001 = m_data(x0, y0, z1);
-	const fl f101 = m_data(x1, y0, z1);
-	const fl f011 = m_data(x0, y1, z1);
-	const fl f111 = m_data(x1, y1, z1);
+	const fl f000 = values[base];
+	const fl f100 = values[base + 1];
+	const fl f010 = values[base + dy];
+	const fl f110 = values[base + dy + 1];
+	const fl f001 = values[base + dz];
+	const fl f101 = values[base + dz + 1];
+	const fl f011 = values[base + dz + dy];
+	const fl f111 = values[base + dz + dy + 1];
 
 	const fl x = s[0];
 	const fl y = s[1];
@@ -23,6 +23,7 @@
 #ifndef VINA_GRID_H
 #define VINA_GRID_H
 
+#include <algorithm> // min
 #include "array3d.h"
 #include "grid_dim.h"
 #include "curl.h"
@@ -33,23 +34,64 @@ class grid { // FIXME rm 'm_', consistent with my new style
     vec m_factor;
     vec m_dim_fl_minus_1;
 	vec m_factor_inv;
+	boost::array<sz, 3> m_dims; // number of sample points
+	boost::array<sz, 3> m_bricks; // number of bricks, zero unless the values are laid out in bricks
+	const fl* m_view; // non-owning storage, or m_data_bricks, m_data stays empty while this is set
+	const float* m_view_single; // single precision storage, either m_data_single or non-owning; m_data and m_view are unused while this is set
+	std::vector<fl> m_data_bricks;
+	std::vector<float> m_data_single;
 public:
+	// Bricks hold brick_edge^3 values, x fastest, 4 KiB in fl, and overlap by one sample point, so that the 8 corners
+	// of every cell lie in the same page instead of in 4 rows spread over the whole map
+	enum { brick_edge = 8, brick_size = brick_edge * brick_edge * brick_edge };
 	array3d<fl> m_data; // FIXME? - make cache a friend, and convert this back to private?
-	grid() : m_init(0, 0, 0), m_range(1, 1, 1), m_factor(1, 1, 1), m_dim_fl_minus_1(-1, -1, -1), m_factor_inv(1, 1, 1) {} // not private
-	grid(const grid_dims& gd) { init(gd); }
+	grid() : m_init(0, 0, 0), m_range(1, 1, 1), m_factor(1, 1, 1), m_dim_fl_minus_1(-1, -1, -1), m_factor_inv(1, 1, 1), m_view(NULL), m_view_single(NULL) { m_dims.assign(0); m_bricks.assign(0); } // not private
+	grid(const grid_dims& gd) : m_view(NULL), m_view_single(NULL) { init(gd); }
     void init(const grid_dims& gd);
+	void init(const grid_dims& gd, const fl* storage, bool bricks = false); // storage holds num_values(gd, bricks) values and must outlive the grid
+	void init(const grid_dims& gd, const float* storage, bool bricks = false); // same, in single precision
+	void to_single_precision(); // converts the populated values to float, evaluation still accumulates in fl
+	void to_bricks(); // lays the populated values out in bricks
+	static sz num_values(const grid_dims& gd, bool bricks = false);
+	sz num_values() const;
+	sz dim(sz i) const { return m_dims[i]; }
+	bool single_precision() const { return m_view_single != NULL; }
+	bool bricks() const { return m_bricks[0] > 0; }
+	sz value_size() const { return single_precision() ? sizeof(float) : sizeof(fl); }
+	const void* storage() const { return single_precision() ? static_cast<const void*>(m_view_single) : static_cast<const void*>(data()); } // num_values() values of value_size() bytes
+	const fl* data() const { assert(!m_view_single); return m_view ? m_view : m_data.data(); }
+	bool shared() const { return single_precision() ? m_data_single.empty() : (m_view != NULL && m_data_bricks.empty()); }
+	sz index(sz x, sz y, sz z) const { // of the value at a sample point in storage()
+		if(!bricks()) return x + m_dims[0]*(y + m_dims[1]*z);
+		const sz bx = brick(x, 0), by = brick(y, 1), bz = brick(z, 2);
+		return brick_size * (bx + m_bricks[0]*(by + m_bricks[1]*bz)) + (x - (brick_edge-1)*bx) + brick_edge*((y - (brick_edge-1)*by) + brick_edge*(z - (brick_edge-1)*bz));
+	}
+	fl operator()(sz x, sz y, sz z) const { const sz i = index(x, y, z); return m_view_single ? fl(m_view_single[i]) : data()[i]; }
+	fl& operator()(sz x, sz y, sz z) { assert(!m_view && !m_view_single); return m_data(x, y, z); }
 	vec index_to_argument(sz x, sz y, sz z) const {
 		return vec(m_init[0] + m_factor_inv[0] * x,
 		           m_init[1] + m_factor_inv[1] * y,
 		           m_init[2] + m_factor_inv[2] * z);
 	}
 	bool initialized() const {
-		return m_data.dim0() > 0 && m_data.dim1() > 0 && m_data.dim2() > 0;
+		return m_dims[0] > 0 && m_dims[1] > 0 && m_dims[2] > 0;
 	}
 	fl evaluate(const vec& location, fl slope, fl c)             const { return evaluate_aux(location, slope, c, NULL);   }
 	fl evaluate(const vec& location, fl slope, fl c, vec& deriv) const { return evaluate_aux(location, slope, c, &deriv); } // sets deriv
+	enum { batch_size = 4 };
+	// evaluates n <= batch_size locations at once, with the same results as evaluate(*locations[k], slope, c, *derivs[k])
+	void evaluate(sz n, const vec* const* locations, fl slope, fl c, fl* energies, vec* const* derivs) const;
+	static bool simd; // whether the batches use the AVX2 kernel, set when the CPU supports it
 private:
+	void init_geometry(const grid_dims& gd, bool bricks);
+	sz brick(sz x, sz i) const { return (std::min)(x / (brick_edge-1), m_bricks[i] - 1); } // the last sample point belongs to the last brick
+	template<typename T>
+	void to_bricks(const T* values, std::vector<T>& bricked) const;
 	fl evaluate_aux(const vec& location, fl slope, fl v, vec* deriv) const; // sets *deriv if not NULL
+	template<typename T, bool Bricks>
+	fl evaluate_aux(const T* values, const vec& location, fl slope, fl v, vec* deriv) const;
+	template<typename T, bool Bricks>
+	void evaluate_avx2(const T* values, const vec* const* locations, fl slope, fl v, fl* energies, vec* const* derivs) const; // batch_size locations, see grid_avx2.cpp
 	friend class boost::serialization::access;
 	template<class Archive>
 	void serialize(Archive& ar, const unsigned version) {
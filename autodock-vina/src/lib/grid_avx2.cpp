@@ -0,0 +1,225 @@
+/*
+
+   Copyright (c) 2006-2010, The Scripps Research Institute
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+   Author: Dr. Oleg Trott <ot14@columbia.edu>, 
+           The Olson Lab, 
+           The Scripps Research Institute
+
+*/
+
+// AVX2 kernel of grid::evaluate for batches of locations. Every lane repeats the operations of
+// grid::evaluate_aux in the same order and without FMA contraction, so the results are bit-identical
+// to the scalar path. The kernel is compiled for AVX2 with a function attribute and is only called
+// when the CPU supports it, the rest of the library keeps the baseline instruction set.
+
+#include "grid.h"
+#include "simd.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define VINA_GRID_AVX2 1
+#include <immintrin.h>
+#else
+#define VINA_GRID_AVX2 0
+#endif
+
+#if VINA_GRID_AVX2
+
+namespace {
+
+#define VINA_AVX2 __attribute__((target("avx2"), always_inline)) inline
+
+VINA_AVX2 __m256d select(__m256d mask, __m256d a, __m256d b) { return _mm256_blendv_pd(b, a, mask); } // mask ? a : b
+VINA_AVX2 __m256d negate(__m256d a) { return _mm256_xor_pd(a, _mm256_set1_pd(-0.0)); }
+
+VINA_AVX2 __m256d gather(const fl* values, __m128i index) { return _mm256_i32gather_pd(values, index, sizeof(fl)); }
+VINA_AVX2 __m256d gather(const float* values, __m128i index) { return _mm256_cvtps_pd(_mm_i32gather_ps(values, index, sizeof(float))); }
+
+struct axis { // one coordinate of the 4 lanes, after clamping to the grid
+	__m256d s; // fractional position in the cell
+	__m256d a; // cell index, as an exact integer
+	__m256d miss;
+	__m256d region;
+};
+
+VINA_AVX2 axis clamp(__m256d location, fl init, fl factor, fl dim_fl_minus_1, sz dim) {
+	axis r;
+	const __m256d s = _mm256_mul_pd(_mm256_sub_pd(location, _mm256_set1_pd(init)), _mm256_set1_pd(factor));
+	const __m256d below = _mm256_cmp_pd(s, _mm256_setzero_pd(), _CMP_LT_OQ);
+	const __m256d above = _mm256_cmp_pd(s, _mm256_set1_pd(dim_fl_minus_1), _CMP_GE_OQ);
+	const __m256d a = _mm256_floor_pd(s); // s >= 0 inside, so this is sz(s)
+	r.miss   = select(below, negate(s), select(above, _mm256_sub_pd(s, _mm256_set1_pd(dim_fl_minus_1)), _mm256_setzero_pd()));
+	r.region = select(below, _mm256_set1_pd(-1), select(above, _mm256_set1_pd(1), _mm256_setzero_pd()));
+	r.a      = select(below, _mm256_setzero_pd(), select(above, _mm256_set1_pd(fl(dim - 2)), a));
+	r.s      = select(below, _mm256_setzero_pd(), select(above, _mm256_set1_pd(1), _mm256_sub_pd(s, a)));
+	return r;
+}
+
+VINA_AVX2 __m256d mul(__m256d a, __m256d b) { return _mm256_mul_pd(a, b); }
+VINA_AVX2 __m256d mul(__m256d a, __m256d b, __m256d c) { return mul(mul(a, b), c); }
+VINA_AVX2 __m256d mul(__m256d a, __m256d b, __m256d c, __m256d d) { return mul(mul(mul(a, b), c), d); }
+VINA_AVX2 __m256d add(__m256d a, __m256d b) { return _mm256_add_pd(a, b); }
+
+}
+
+template<typename T, bool Bricks>
+__attribute__((target("avx2")))
+void grid::evaluate_avx2(const T* values, const vec* const* locations, fl slope, fl v, fl* energies, vec* const* derivs) const {
+	const vec& l0 = *locations[0];
+	const vec& l1 = *locations[1];
+	const vec& l2 = *locations[2];
+	const vec& l3 = *locations[3];
+	axis ax[3];
+	VINA_FOR(i, 3)
+		ax[i] = clamp(_mm256_set_pd(l3[i], l2[i], l1[i], l0[i]), m_init[i], m_factor[i], m_dim_fl_minus_1[i], m_dims[i]);
+
+	const __m256d penalty = mul(_mm256_set1_pd(slope), add(add(mul(ax[0].miss, _mm256_set1_pd(m_factor_inv[0])),
+	                                                           mul(ax[1].miss, _mm256_set1_pd(m_factor_inv[1]))),
+	                                                           mul(ax[2].miss, _mm256_set1_pd(m_factor_inv[2]))));
+
+	__m256d base;
+	sz dy, dz;
+	if(Bricks) { // the integers are exact in fl
+		const __m256d e = _mm256_set1_pd(brick_edge - 1);
+		const __m256d half = _mm256_set1_pd(0.5);
+		const __m256d bx = _mm256_floor_pd(_mm256_div_pd(add(ax[0].a, half), e));
+		const __m256d by = _mm256_floor_pd(_mm256_div_pd(add(ax[1].a, half), e));
+		const __m256d bz = _mm256_floor_pd(_mm256_div_pd(add(ax[2].a, half), e));
+		const __m256d edge = _mm256_set1_pd(brick_edge);
+		const __m256d brick = add(bx, mul(_mm256_set1_pd(fl(m_bricks[0])), add(by, mul(_mm256_set1_pd(fl(m_bricks[1])), bz))));
+		const __m256d local = add(_mm256_sub_pd(ax[0].a, mul(e, bx)),
+		                          mul(edge, add(_mm256_sub_pd(ax[1].a, mul(e, by)), mul(edge, _mm256_sub_pd(ax[2].a, mul(e, bz))))));
+		base = add(mul(_mm256_set1_pd(brick_size), brick), local);
+		dy = brick_edge;
+		dz = brick_edge * brick_edge;
+	}
+	else {
+		base = add(ax[0].a, mul(_mm256_set1_pd(fl(m_dims[0])), add(ax[1].a, mul(_mm256_set1_pd(fl(m_dims[1])), ax[2].a))));
+		dy = m_dims[0];
+		dz = m_dims[0] * m_dims[1];
+	}
+	const __m128i i000 = _mm256_cvtpd_epi32(base);
+	const __m128i i010 = _mm_add_epi32(i000, _mm_set1_epi32(int(dy)));
+	const __m128i i001 = _mm_add_epi32(i000, _mm_set1_epi32(int(dz)));
+	const __m128i i011 = _mm_add_epi32(i000, _mm_set1_epi32(int(dy + dz)));
+	const __m128i one = _mm_set1_epi32(1);
+
+	const __m256d f000 = gather(values, i000);
+	const __m256d f100 = gather(values, _mm_add_epi32(i000, one));
+	const __m256d f010 = gather(values, i010);
+	const __m256d f110 = gather(values, _mm_add_epi32(i010, one));
+	const __m256d f001 = gather(values, i001);
+	const __m256d f101 = gather(values, _mm_add_epi32(i001, one));
+	const __m256d f011 = gather(values, i011);
+	const __m256d f111 = gather(values, _mm_add_epi32(i011, one));
+
+	const __m256d x = ax[0].s;
+	const __m256d y = ax[1].s;
+	const __m256d z = ax[2].s;
+	const __m256d ones = _mm256_set1_pd(1);
+	const __m256d mx = _mm256_sub_pd(ones, x);
+	const __m256d my = _mm256_sub_pd(ones, y);
+	const __m256d mz = _mm256_sub_pd(ones, z);
+
+	__m256d f = mul(f000, mx, my, mz);
+	f = add(f, mul(f100,  x, my, mz));
+	f = add(f, mul(f010, mx,  y, mz));
+	f = add(f, mul(f110,  x,  y, mz));
+	f = add(f, mul(f001, mx, my,  z));
+	f = add(f, mul(f101,  x, my,  z));
+	f = add(f, mul(f011, mx,  y,  z));
+	f = add(f, mul(f111,  x,  y,  z));
+
+	// f * (-1) * a * b == (-f) * a * b and f * 1 * a * b == f * a * b exactly
+	__m256d x_g = mul(negate(f000), my, mz);
+	x_g = add(x_g, mul(f100, my, mz));
+	x_g = add(x_g, mul(negate(f010),  y, mz));
+	x_g = add(x_g, mul(f110,  y, mz));
+	x_g = add(x_g, mul(negate(f001), my,  z));
+	x_g = add(x_g, mul(f101, my,  z));
+	x_g = add(x_g, mul(negate(f011),  y,  z));
+	x_g = add(x_g, mul(f111,  y,  z));
+
+	__m256d y_g = mul(negate(mul(f000, mx)), mz);
+	y_g = add(y_g, mul(negate(mul(f100,  x)), mz));
+	y_g = add(y_g, mul(f010, mx, mz));
+	y_g = add(y_g, mul(f110,  x, mz));
+	y_g = add(y_g, mul(negate(mul(f001, mx)),  z));
+	y_g = add(y_g, mul(negate(mul(f101,  x)),  z));
+	y_g = add(y_g, mul(f011, mx,  z));
+	y_g = add(y_g, mul(f111,  x,  z));
+
+	__m256d z_g = negate(mul(f000, mx, my));
+	z_g = add(z_g, negate(mul(f100,  x, my)));
+	z_g = add(z_g, negate(mul(f010, mx,  y)));
+	z_g = add(z_g, negate(mul(f110,  x,  y)));
+	z_g = add(z_g, mul(f001, mx, my));
+	z_g = add(z_g, mul(f101,  x, my));
+	z_g = add(z_g, mul(f011, mx,  y));
+	z_g = add(z_g, mul(f111,  x,  y));
+
+	if(not_max(v)) { // curl
+		const __m256d positive = _mm256_cmp_pd(f, _mm256_setzero_pd(), _CMP_GT_OQ);
+		const __m256d vv = _mm256_set1_pd(v);
+		const __m256d tmp = (v < epsilon_fl) ? _mm256_setzero_pd() : _mm256_div_pd(vv, add(vv, f));
+		const __m256d tmp_sqr = mul(tmp, tmp);
+		f   = select(positive, mul(f, tmp), f);
+		x_g = select(positive, mul(x_g, tmp_sqr), x_g);
+		y_g = select(positive, mul(y_g, tmp_sqr), y_g);
+		z_g = select(positive, mul(z_g, tmp_sqr), z_g);
+	}
+
+	const __m256d gradient[3] = { x_g, y_g, z_g };
+	__m256d deriv[3];
+	VINA_FOR(i, 3) {
+		const __m256d inside = _mm256_cmp_pd(ax[i].region, _mm256_setzero_pd(), _CMP_EQ_OQ);
+		deriv[i] = add(mul(_mm256_set1_pd(m_factor[i]), select(inside, gradient[i], _mm256_setzero_pd())),
+		               mul(_mm256_set1_pd(slope), ax[i].region));
+	}
+
+	alignas(32) fl e[batch_size];
+	alignas(32) fl d[3][batch_size];
+	_mm256_store_pd(e, add(f, penalty));
+	VINA_FOR(i, 3)
+		_mm256_store_pd(d[i], deriv[i]);
+	VINA_FOR(k, batch_size) {
+		energies[k] = e[k];
+		VINA_FOR(i, 3)
+			(*derivs[k])[i] = d[i][k];
+	}
+}
+
+template void grid::evaluate_avx2<fl,    false>(const fl*,    const vec* const*, fl, fl, fl*, vec* const*) const;
+template void grid::evaluate_avx2<fl,    true >(const fl*,    const vec* const*, fl, fl, fl*, vec* const*) const;
+template void grid::evaluate_avx2<float, false>(const float*, const vec* const*, fl, fl, fl*, vec* const*) const;
+template void grid::evaluate_avx2<float, true >(const float*, const vec* const*, fl, fl, fl*, vec* const*) const;
+
+bool grid::simd = avx2_supported();
+
+#else
+
+template<typename T, bool Bricks>
+void grid::evaluate_avx2(const T* values, const vec* const* locations, fl slope, fl v, fl* energies, vec* const* derivs) const {
+	VINA_CHECK(false); // never called, simd stays false
+}
+
+template void grid::evaluate_avx2<fl,    false>(const fl*,    const vec* const*, fl, fl, fl*, vec* const*) const;
+template void grid::evaluate_avx2<fl,    true >(const fl*,    const vec* const*, fl, fl, fl*, vec* const*) const;
+template void grid::evaluate_avx2<float, false>(const float*, const vec* const*, fl, fl, fl*, vec* const*) const;
+template void grid::evaluate_avx2<float, true >(const float*, const vec* const*, fl, fl, fl*, vec* const*) const;
+
+bool grid::simd = false;
+
+#endif
@@ -0,0 +1,130 @@
+/*
+
+   Copyright (c) 2006-2010, The Scripps Research Institute
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+   Author: Dr. Oleg Trott <ot14@columbia.edu>, 
+           The Olson Lab, 
+           The Scripps Research Institute
+
+*/
+
+#include <cstring>
+#include <sstream>
+#include <iomanip>
+#include <boost/static_assert.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include "grid_map.h"
+#include "file.h"
+#include "cache.h"
+
+BOOST_STATIC_ASSERT(sizeof(grid_map_header) <= grid_map_header_size);
+BOOST_STATIC_ASSERT(grid_map_header_size % sizeof(fl) == 0);
+
+namespace {
+	const char grid_map_magic[8] = {'V', 'I', 'N', 'A', 'G', 'M', 'A', 'P'};
+}
+
+void grid_map_key::add(const void* data, sz size) {
+	const unsigned char* p = static_cast<const unsigned char*>(data);
+	VINA_FOR(i, size) {
+		value ^= p[i];
+		value *= 1099511628211ULL;
+	}
+}
+
+void grid_map_key::add(const grid_dims& gd) {
+	VINA_FOR_IN(i, gd) {
+		add(gd[i].begin);
+		add(gd[i].end);
+		add(gd[i].n);
+	}
+}
+
+void grid_map_key::add_file(const path& name) {
+	ifile in(name, std::ios::binary);
+	char buffer[1 << 16];
+	while(in) {
+		in.read(buffer, sizeof(buffer));
+		add(buffer, sz(in.gcount()));
+	}
+}
+
+std::string grid_map_key::str() const {
+	std::ostringstream out;
+	out << std::hex << std::setfill('0') << std::setw(16) << value;
+	return out.str();
+}
+
+grid_map_header::grid_map_header() {
+	std::memset(this, 0, sizeof(*this));
+}
+
+grid_map_header::grid_map_header(const std::string& scoring_function_version_, const grid_dims& gd, atom_type::t atu, sz num_types_, sz value_size_, bool bricks_, const grid_map_key& key_) {
+	std::memset(this, 0, sizeof(*this));
+	std::memcpy(magic, grid_map_magic, sizeof(magic));
+	format_version = boost::uint32_t(grid_map_format_version);
+	value_size = boost::uint32_t(value_size_);
+	atom_typing = boost::uint32_t(atu);
+	num_types = boost::uint32_t(num_types_);
+	bricks = bricks_ ? 1 : 0;
+	num_values = grid::num_values(gd, bricks_);
+	key = key_.value;
+	VINA_FOR(i, 3) {
+		begin[i] = gd[i].begin;
+		end[i] = gd[i].end;
+		n[i] = gd[i].n;
+	}
+	VINA_CHECK(scoring_function_version_.size() < sizeof(scoring_function_version));
+	std::memcpy(scoring_function_version, scoring_function_version_.data(), scoring_function_version_.size());
+}
+
+bool grid_map_header::valid() const {
+	return std::memcmp(magic, grid_map_magic, sizeof(magic)) == 0 && format_version == grid_map_format_version && (value_size == sizeof(float) || value_size == sizeof(fl));
+}
+
+grid_dims grid_map_header::dims() const {
+	grid_dims gd;
+	VINA_FOR(i, 3) {
+		gd[i].begin = begin[i];
+		gd[i].end = end[i];
+		gd[i].n = sz(n[i]);
+	}
+	return gd;
+}
+
+sz grid_map_header::file_size() const {
+	return grid_map_header_size + checked_multiply(checked_multiply(sz(num_types), sz(num_values)), sz(value_size));
+}
+
+struct grid_map::mapping {
+	boost::interprocess::file_mapping file;
+	boost::interprocess::mapped_region region;
+	mapping(const path& name) : file(name.string().c_str(), boost::interprocess::read_only), region(file, boost::interprocess::read_only) {}
+};
+
+grid_map::grid_map(const path& name) : address(NULL) {
+	try {
+		m.reset(new mapping(name));
+	}
+	catch(boost::interprocess::interprocess_exception&) {
+		throw file_error(name, true);
+	}
+	address = static_cast<const char*>(m->region.get_address());
+	if(m->region.get_size() < grid_map_header_size || !header().valid() || m->region.get_size() != header().file_size())
+		throw cache_mismatch();
+}
+
+grid_map::~grid_map() {}
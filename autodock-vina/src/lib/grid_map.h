@@ -0,0 +1,85 @@
+/*
+
+   Copyright (c) 2006-2010, The Scripps Research Institute
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+   Author: Dr. Oleg Trott <ot14@columbia.edu>, 
+           The Olson Lab, 
+           The Scripps Research Institute
+
+*/
+
+#ifndef VINA_GRID_MAP_H
+#define VINA_GRID_MAP_H
+
+#include <string>
+#include <boost/cstdint.hpp>
+#include <boost/scoped_ptr.hpp>
+#include "grid_dim.h"
+#include "atom_type.h"
+
+// Binary grid map file: a fixed size header followed by the grids of every atom type, each one
+// grid::num_values(gd, bricks) values in the layout of grid::storage(), so that it can be memory-mapped as is
+
+const sz grid_map_format_version = 2;
+const sz grid_map_header_size = 256; // the values start here, keeps them aligned
+
+struct grid_map_key { // 64-bit FNV-1a
+	boost::uint64_t value;
+	grid_map_key() : value(14695981039346656037ULL) {}
+	void add(const void* data, sz size);
+	void add(const std::string& s) { add(s.data(), s.size()); }
+	void add(fl x) { add(&x, sizeof(fl)); }
+	void add(sz x) { boost::uint64_t tmp = x; add(&tmp, sizeof(tmp)); }
+	void add(const grid_dims& gd);
+	void add_file(const path& name); // the contents of name, can throw file_error
+	std::string str() const; // 16 hex digits
+};
+
+struct grid_map_header {
+	char magic[8];
+	boost::uint32_t format_version;
+	boost::uint32_t value_size; // sizeof(float) or sizeof(fl), see cache::value_size
+	boost::uint32_t atom_typing;
+	boost::uint32_t num_types;
+	boost::uint32_t bricks; // layout of the values, see grid.h
+	boost::uint32_t reserved;
+	boost::uint64_t num_values; // per atom type
+	boost::uint64_t key;
+	fl begin[3];
+	fl end[3];
+	boost::uint64_t n[3];
+	char scoring_function_version[64];
+
+	grid_map_header();
+	grid_map_header(const std::string& scoring_function_version_, const grid_dims& gd, atom_type::t atu, sz num_types_, sz value_size_, bool bricks_, const grid_map_key& key_);
+	bool valid() const; // magic, format version and value size
+	grid_dims dims() const;
+	sz file_size() const;
+};
+
+struct grid_map {
+	grid_map(const path& name); // maps name read-only, can throw file_error or cache_mismatch if it is not a grid map of this build
+	~grid_map();
+	const grid_map_header& header() const { return *reinterpret_cast<const grid_map_header*>(address); }
+	const void* values() const { return address + grid_map_header_size; }
+private:
+	struct mapping; // boost::interprocess, kept out of the header: it pulls in fcntl.h, which declares tee
+	boost::scoped_ptr<mapping> m;
+	const char* address;
+	grid_map(const grid_map&);
+	grid_map& operator=(const grid_map&);
+};
+
+#endif
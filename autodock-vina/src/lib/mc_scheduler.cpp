@@ -0,0 +1,84 @@
+/*
+
+   Copyright (c) 2006-2010, The Scripps Research Institute
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+   Author: Dr. Oleg Trott <ot14@columbia.edu>, 
+           The Olson Lab, 
+           The Scripps Research Institute
+
+*/
+
+#include "mc_scheduler.h"
+
+mc_scheduler::mc_scheduler(sz num_threads) : m_num_threads((num_threads > 1) ? num_threads : 1), destructing(false), pinned(false) {
+	VINA_FOR(i, m_num_threads)
+		threads.push_back(create_thread(aux(this)));
+}
+
+void mc_scheduler::pin_threads() {
+	boost::mutex::scoped_lock self_lk(self);
+	if(pinned) return;
+	pinned = true;
+	const std::vector<int> cores = allowed_cores();
+	if(cores.empty()) return;
+	VINA_FOR_IN(i, threads) // from the last core down, thread_pool pins its threads from the first one up
+		pin_thread(*threads[i], cores[cores.size() - 1 - i % cores.size()]);
+}
+
+mc_scheduler::~mc_scheduler() {
+	{
+		boost::mutex::scoped_lock self_lk(self);
+		destructing = true;
+		cond.notify_all(); // destructing modified
+	}
+	join_all();
+}
+
+void mc_scheduler::run(const std::vector<job>& jobs) {
+	if(jobs.empty()) return;
+	batch b(jobs.size());
+	boost::mutex::scoped_lock self_lk(self);
+	VINA_FOR_IN(i, jobs)
+		queue.push_back(entry(&jobs[i], &b));
+	cond.notify_all(); // queue modified
+	while(b.remaining > 0)
+		b.done.wait(self_lk);
+	if(b.error)
+		std::rethrow_exception(b.error);
+}
+
+void mc_scheduler::loop() {
+	boost::mutex::scoped_lock self_lk(self);
+	while(true) {
+		while(!destructing && queue.empty())
+			cond.wait(self_lk);
+		if(destructing) return; // run() never returns before its jobs finished, so the queue is empty by now
+		entry e = queue.front();
+		queue.pop_front();
+		std::exception_ptr error;
+		self_lk.unlock();
+		try {
+			(*e.f)();
+		}
+		catch(...) {
+			error = std::current_exception();
+		}
+		self_lk.lock();
+		if(error && !e.b->error)
+			e.b->error = error;
+		if(--e.b->remaining == 0)
+			e.b->done.notify_one();
+	}
+}
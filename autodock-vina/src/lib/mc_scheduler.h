@@ -0,0 +1,78 @@
+/*
+
+   Copyright (c) 2006-2010, The Scripps Research Institute
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+   Author: Dr. Oleg Trott <ot14@columbia.edu>, 
+           The Olson Lab, 
+           The Scripps Research Institute
+
+*/
+
+#ifndef VINA_MC_SCHEDULER_H
+#define VINA_MC_SCHEDULER_H
+
+#include <deque>
+#include <exception>
+#include <vector>
+#include <boost/function.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition.hpp>
+#include "common.h"
+#include "thread_pool.h"
+
+// A persistent pool of threads shared by the ligands docked concurrently in a process. The jobs (Monte
+// Carlo chains) are run in the order they were submitted, so the chains of the next ligand fill the
+// threads freed by the last chains of the current one, instead of every ligand starting and joining
+// its own threads
+struct mc_scheduler : private boost::thread_group {
+	typedef boost::function<void()> job;
+
+	mc_scheduler(sz num_threads);
+	~mc_scheduler();
+
+	sz num_threads() const { return m_num_threads; }
+	void pin_threads(); // binds every thread to one of the cores the process may run on, the last ones first
+	void run(const std::vector<job>& jobs); // queues the jobs and blocks until all of them finished, rethrows the first exception of one
+private:
+	struct batch { // the jobs of one call to run
+		sz remaining;
+		std::exception_ptr error;
+		boost::condition done;
+		batch(sz remaining_) : remaining(remaining_) {}
+	};
+	struct entry {
+		const job* f;
+		batch* b;
+		entry(const job* f_, batch* b_) : f(f_), b(b_) {}
+	};
+	struct aux {
+		mc_scheduler* par;
+		aux(mc_scheduler* par_) : par(par_) {}
+		void operator()() const { par->loop(); }
+	};
+
+	void loop();
+
+	sz m_num_threads;
+	std::vector<boost::thread*> threads; // owned by the thread_group
+	bool destructing;
+	bool pinned;
+	std::deque<entry> queue;
+	boost::condition cond;
+	boost::mutex self; // any modification or reading of mutables should lock this first
+};
+
+#endif
@@ -558,7 +558,7 @@ std::string coords_to_pdbqt_string(const vec& coords, const std::string& str) {
 	return tmp;
 }
 
-void model::write_context(const context& c, ofile& out) const {
+void model::write_context(const context& c, std::ostream& out) const {
 	verify_bond_lengths();
 	VINA_FOR_IN(i, c) {
 		const std::string& str = c[i].first;
@@ -616,20 +616,39 @@ fl eval_interacting_pairs(const precalculate& p, fl v, const interacting_pairs&
 }
 
 fl eval_interacting_pairs_deriv(const precalculate& p, fl v, const interacting_pairs& pairs, const vecv& coords, vecv& forces) { // adds to forces  // clean up
+	// The pairs within the cutoff are looked up in batches of precalculate::batch_size. The energies and
+	// forces are accumulated in pair order afterwards, so that the result doesn't depend on the batching.
 	const fl cutoff_sqr = p.cutoff_sqr();
 	fl e = 0;
+	const interacting_pair* batch[precalculate::batch_size];
+	vec rs[precalculate::batch_size];
+	sz type_pair_indices[precalculate::batch_size];
+	fl r2s[precalculate::batch_size];
+	fl energies[precalculate::batch_size];
+	fl dors[precalculate::batch_size];
+	sz k = 0;
 	VINA_FOR_IN(i, pairs) {
 		const interacting_pair& ip = pairs[i];
 		vec r; r = coords[ip.b] - coords[ip.a]; // a -> b
 		fl r2 = sqr(r);
 		if(r2 < cutoff_sqr) {
-			pr tmp = p.eval_deriv(ip.type_pair_index, r2);
-			vec force; force = tmp.second * r;
-			curl(tmp.first, force, v);
-			e += tmp.first;
-			// FIXME inefficient, if using hard curl
-			forces[ip.a] -= force; // we could omit forces on inflex here
-			forces[ip.b] += force;
+			batch[k] = &ip;
+			rs[k] = r;
+			type_pair_indices[k] = ip.type_pair_index;
+			r2s[k] = r2;
+			++k;
+		}
+		if(k == precalculate::batch_size || (k > 0 && i + 1 == pairs.size())) {
+			p.eval_deriv(k, type_pair_indices, r2s, energies, dors);
+			VINA_FOR(j, k) {
+				vec force; force = dors[j] * rs[j];
+				curl(energies[j], force, v);
+				e += energies[j];
+				// FIXME inefficient, if using hard curl
+				forces[batch[j]->a] -= force; // we could omit forces on inflex here
+				forces[batch[j]->b] += force;
+			}
+			k = 0;
 		}
 	}
 	return e;
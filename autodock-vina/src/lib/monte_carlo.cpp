@@ -44,19 +44,21 @@ void monte_carlo::single_run(model& m, output_type& out, const precalculate& p,
 	vec authentic_v(1000, 1000, 1000);
 	out.e = max_fl;
 	output_type current(out);
-	quasi_newton quasi_newton_par; quasi_newton_par.max_steps = ssd_par.evals;
+	output_type candidate(current);
+	quasi_newton quasi_newton_par; quasi_newton_par.max_steps = ssd_par.evals; quasi_newton_par.lbfgs_history = lbfgs_history;
+	quasi_newton_workspace w = quasi_newton_par.workspace(out.c, g);
 	VINA_U_FOR(step, num_steps) {
-		output_type candidate(current.c, max_fl);
+		candidate.c = current.c; candidate.e = max_fl;
 		mutate_conf(candidate.c, m, mutation_amplitude, generator);
-		quasi_newton_par(m, p, ig, candidate, g, hunt_cap);
+		quasi_newton_par(m, p, ig, candidate, g, hunt_cap, w);
 		if(step == 0 || metropolis_accept(current.e, candidate.e, temperature, generator)) {
-			quasi_newton_par(m, p, ig, candidate, g, authentic_v);
+			quasi_newton_par(m, p, ig, candidate, g, authentic_v, w);
 			current = candidate;
 			if(current.e < out.e)
 				out = current;
 		}
 	}
-	quasi_newton_par(m, p, ig, out, g, authentic_v);
+	quasi_newton_par(m, p, ig, out, g, authentic_v, w);
 }
 
 void monte_carlo::many_runs(model& m, output_container& out, const precalculate& p, const igrid& ig, const vec& corner1, const vec& corner2, sz num_runs, rng& generator) const {
@@ -86,13 +88,15 @@ void monte_carlo::operator()(model& m, output_container& out, const precalculate
 	output_type tmp(s, 0);
 	tmp.c.randomize(corner1, corner2, generator);
 	fl best_e = max_fl;
-	quasi_newton quasi_newton_par; quasi_newton_par.max_steps = ssd_par.evals;
+	quasi_newton quasi_newton_par; quasi_newton_par.max_steps = ssd_par.evals; quasi_newton_par.lbfgs_history = lbfgs_history;
+	quasi_newton_workspace w = quasi_newton_par.workspace(tmp.c, g); // the steps below only allocate when a minimum is saved
+	output_type candidate = tmp;
 	VINA_U_FOR(step, num_steps) {
 		if(increment_me)
 			++(*increment_me);
-		output_type candidate = tmp;
+		candidate = tmp;
 		mutate_conf(candidate.c, m, mutation_amplitude, generator);
-		quasi_newton_par(m, p, ig, candidate, g, hunt_cap);
+		quasi_newton_par(m, p, ig, candidate, g, hunt_cap, w);
 		if(step == 0 || metropolis_accept(tmp.e, candidate.e, temperature, generator)) {
 			tmp = candidate;
 
@@ -100,7 +104,7 @@ void monte_carlo::operator()(model& m, output_container& out, const precalculate
 
 			// FIXME only for very promising ones
 			if(tmp.e < best_e || out.size() < num_saved_mins) {
-				quasi_newton_par(m, p, ig, tmp, g, authentic_v);
+				quasi_newton_par(m, p, ig, tmp, g, authentic_v, w);
 				m.set(tmp.c); // FIXME? useless?
 				tmp.coords = m.get_heavy_atom_movable_coords();
 				add_to_output_container(out, tmp, min_rmsd, num_saved_mins); // 20 - max size
@@ -24,6 +24,7 @@
 #include "parallel_mc.h"
 #include "coords.h"
 #include "parallel_progress.h"
+#include "mc_scheduler.h"
 
 struct parallel_mc_task {
 	model m;
@@ -50,6 +51,13 @@ struct parallel_mc_aux {
 	}
 };
 
+struct parallel_mc_job { // one chain, as a job of mc_scheduler
+	const parallel_mc_aux* aux;
+	parallel_mc_task* task;
+	parallel_mc_job(const parallel_mc_aux* aux_, parallel_mc_task* task_) : aux(aux_), task(task_) {}
+	void operator()() const { (*aux)(*task); }
+};
+
 void merge_output_containers(const output_container& in, output_container& out, fl min_rmsd, sz max_size) {
 	VINA_FOR_IN(i, in)
 		add_to_output_container(out, in[i], min_rmsd, max_size);
@@ -70,7 +78,15 @@ void parallel_mc::operator()(const model& m, output_container& out, const precal
 		task_container.push_back(new parallel_mc_task(m, random_int(0, 1000000, generator)));
 	if(display_progress) 
 		pp.init(num_tasks * mc.num_steps);
-	parallel_iter<parallel_mc_aux, parallel_mc_task_container, parallel_mc_task, true> parallel_iter_instance(&parallel_mc_aux_instance, num_threads);
-	parallel_iter_instance.run(task_container);
+	if(scheduler) {
+		std::vector<mc_scheduler::job> jobs;
+		VINA_FOR_IN(i, task_container)
+			jobs.push_back(parallel_mc_job(&parallel_mc_aux_instance, &task_container[i]));
+		scheduler->run(jobs);
+	}
+	else {
+		parallel_iter<parallel_mc_aux, parallel_mc_task_container, parallel_mc_task, true> parallel_iter_instance(&parallel_mc_aux_instance, num_threads);
+		parallel_iter_instance.run(task_container);
+	}
 	merge_output_containers(task_container, out, mc.min_rmsd, mc.num_saved_mins);
 }
@@ -25,12 +25,15 @@
 
 #include "monte_carlo.h"
 
+struct mc_scheduler;
+
 struct parallel_mc {
 	monte_carlo mc;
 	sz num_tasks;
 	sz num_threads;
 	bool display_progress;
-	parallel_mc() : num_tasks(8), num_threads(1), display_progress(true) {}
+	mc_scheduler* scheduler; // if set, the chains run on its threads rather than on num_threads of their own
+	parallel_mc() : num_tasks(8), num_threads(1), display_progress(true), scheduler(NULL) {}
 	void operator()(const model& m, output_container& out, const precalculate& p, const igrid& ig, const precalculate& p_widened, const igrid& ig_widened, const vec& corner1, const vec& corner2, rng& generator) const;
 };
 
@@ -468,8 +468,7 @@ void postprocess_residue(non_rigid_parsed& nr, parsing_struct& p, context& c) {
 	VINA_CHECK(nr.atoms_inflex_bonds.dim_2() == nr.inflex.size());
 }
 
-void parse_pdbqt_ligand(const path& name, non_rigid_parsed& nr, context& c) {
-	ifile in(name);
+void parse_pdbqt_ligand(std::istream& in, const path& name, non_rigid_parsed& nr, context& c) {
 	unsigned count = 0;
 	parsing_struct p;
 	boost::optional<unsigned> torsdof;
@@ -615,10 +614,10 @@ struct pdbqt_initializer {
 	}
 };
 
-model parse_ligand_pdbqt  (const path& name) { // can throw parse_error
+model parse_ligand_pdbqt  (std::istream& in, const path& name) { // can throw parse_error
 	non_rigid_parsed nrp;
 	context c;
-	parse_pdbqt_ligand(name, nrp, c);
+	parse_pdbqt_ligand(in, name, nrp, c);
 
 	pdbqt_initializer tmp;
 	tmp.initialize_from_nrp(nrp, c, true);
@@ -626,6 +625,11 @@ model parse_ligand_pdbqt  (const path& name) { // can throw parse_error
 	return tmp.m;
 }
 
+model parse_ligand_pdbqt  (const path& name) { // can throw parse_error
+	ifile in(name);
+	return parse_ligand_pdbqt(in, name);
+}
+
 model parse_receptor_pdbqt(const path& rigid_name, const path& flex_name) { // can throw parse_error
 	rigid r;
 	non_rigid_parsed nrp;
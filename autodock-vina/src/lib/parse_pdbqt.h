@@ -23,10 +23,12 @@
 #ifndef VINA_PARSE_PDBQT_H
 #define VINA_PARSE_PDBQT_H
 
+#include <iosfwd>
 #include "model.h"
 
 model parse_receptor_pdbqt(const path& rigid, const path& flex); // can throw parse_error
 model parse_receptor_pdbqt(const path& rigid); // can throw parse_error
 model parse_ligand_pdbqt  (const path& name); // can throw parse_error
+model parse_ligand_pdbqt  (std::istream& in, const path& name); // name only labels the errors, can throw parse_error
 
 #endif
@@ -23,6 +23,7 @@
 #ifndef VINA_PRECALCULATE_H
 #define VINA_PRECALCULATE_H
 
+#include <boost/align/aligned_allocator.hpp>
 #include "scoring_function.h"
 #include "matrix.h"
 
@@ -133,15 +134,53 @@ struct precalculate {
 				// init the rest
 				p.init_from_smooth_fst(rs);
 			}
+		pack();
 	}
 	fl eval_fast(sz type_pair_index, fl r2) const {
 		assert(r2 <= m_cutoff_sqr);
-		return data(type_pair_index).eval_fast(r2);
+		sz i = sz(factor * r2);
+		assert(i < n);
+		return m_fast[type_pair_index * m_row + i];
 	}
-	pr eval_deriv(sz type_pair_index, fl r2) const {
+	pr eval_deriv(sz type_pair_index, fl r2) const { // same arithmetic as precalculate_element::eval_deriv, on the packed table
 		assert(r2 <= m_cutoff_sqr);
-		return data(type_pair_index).eval_deriv(r2);
+		fl r2_factored = factor * r2;
+		sz i1 = sz(r2_factored);
+		assert(i1 + 1 < n);
+		fl rem = r2_factored - i1;
+		const fl* p = &m_smooth[2 * (type_pair_index * m_row + i1)]; // e1, dor1, e2, dor2
+		fl e   = p[0] + rem * (p[2] - p[0]);
+		fl dor = p[1] + rem * (p[3] - p[1]);
+		return pr(e, dor);
+	}
+	enum { batch_size = 4 };
+	// n <= batch_size lookups at once, with the same results as eval_deriv(type_pair_indices[k], r2s[k])
+	void eval_deriv(sz n, const sz* type_pair_indices, const fl* r2s, fl* energies, fl* dors) const {
+		assert(n <= batch_size);
+		if(simd && n > 1) {
+			sz t[batch_size];
+			fl r2[batch_size];
+			fl e[batch_size];
+			fl dor[batch_size];
+			VINA_FOR(k, batch_size) { // pads the batch with the first lookup
+				t[k]  = type_pair_indices[k < n ? k : 0];
+				r2[k] = r2s[k < n ? k : 0];
+			}
+			eval_deriv_avx2(t, r2, e, dor);
+			VINA_FOR(k, n) {
+				energies[k] = e[k];
+				dors[k] = dor[k];
+			}
+		}
+		else
+			VINA_FOR(k, n) {
+				pr tmp = eval_deriv(type_pair_indices[k], r2s[k]);
+				energies[k] = tmp.first;
+				dors[k] = tmp.second;
+			}
 	}
+	static bool simd; // whether the batches use the AVX2 kernel, set when the CPU supports it
+	const precalculate_element& element(sz type_pair_index) const { return data(type_pair_index); }
 	sz index_permissive(sz t1, sz t2) const { return data.index_permissive(t1, t2); }
 	atom_type::t atom_typing_used() const { return m_atom_typing_used; }
 	fl cutoff_sqr() const { return m_cutoff_sqr; }
@@ -150,8 +189,25 @@ struct precalculate {
 		VINA_FOR(t1, data.dim())
 			VINA_RANGE(t2, t1, data.dim())
 				data(t1, t2).widen(rs, left, right);
+		pack();
 	}
 private:
+	typedef std::vector<fl, boost::alignment::aligned_allocator<fl, 64> > aligned_flv;
+	void pack() { // copies the elements into the packed tables, each type pair starts on a cache line
+		const sz num_pairs = data.dim() * (data.dim() + 1) / 2;
+		m_row = (n + 7) / 8 * 8;
+		m_fast.assign(num_pairs * m_row, 0);
+		m_smooth.assign(2 * num_pairs * m_row, 0);
+		VINA_FOR(t, num_pairs) {
+			const precalculate_element& p = data(t);
+			VINA_FOR(i, n) {
+				m_fast[t * m_row + i] = p.fast[i];
+				m_smooth[2 * (t * m_row + i)    ] = p.smooth[i].first;
+				m_smooth[2 * (t * m_row + i) + 1] = p.smooth[i].second;
+			}
+		}
+	}
+	void eval_deriv_avx2(const sz* type_pair_indices, const fl* r2s, fl* energies, fl* dors) const; // batch_size lookups, see precalculate_avx2.cpp
 	flv calculate_rs() const {
 		flv tmp(n, 0);
 		VINA_FOR(i, n)
@@ -164,6 +220,12 @@ private:
 	atom_type::t m_atom_typing_used;
 
 	triangular_matrix<precalculate_element> data;
+
+	// The tables that the evaluation reads: a row of n bins per type pair, padded to whole cache lines.
+	// m_smooth interleaves (e, dor) per bin, so an interpolation reads 4 consecutive values.
+	sz m_row;
+	aligned_flv m_fast;
+	aligned_flv m_smooth;
 };
 
 #endif
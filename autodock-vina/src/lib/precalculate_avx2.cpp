@@ -0,0 +1,76 @@
+/*
+
+   Copyright (c) 2006-2010, The Scripps Research Institute
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+   Author: Dr. Oleg Trott <ot14@columbia.edu>, 
+           The Olson Lab, 
+           The Scripps Research Institute
+
+*/
+
+// AVX2 kernel of precalculate::eval_deriv for batches of interacting pairs. Each lane reads the 4
+// consecutive values (e1, dor1, e2, dor2) of its bin with one load, the loads are transposed and the
+// interpolation repeats the scalar operations in the same order, so the results are bit-identical.
+
+#include "precalculate.h"
+#include "simd.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define VINA_PRECALCULATE_AVX2 1
+#include <immintrin.h>
+#else
+#define VINA_PRECALCULATE_AVX2 0
+#endif
+
+#if VINA_PRECALCULATE_AVX2
+
+__attribute__((target("avx2")))
+void precalculate::eval_deriv_avx2(const sz* type_pair_indices, const fl* r2s, fl* energies, fl* dors) const {
+	fl r2_factored[batch_size];
+	__m256d bins[batch_size];
+	VINA_FOR(k, batch_size) {
+		assert(r2s[k] <= m_cutoff_sqr);
+		r2_factored[k] = factor * r2s[k];
+		const sz i1 = sz(r2_factored[k]);
+		assert(i1 + 1 < n);
+		bins[k] = _mm256_loadu_pd(&m_smooth[2 * (type_pair_indices[k] * m_row + i1)]);
+	}
+	// bins[k] = (e1, dor1, e2, dor2) of lane k, transposed into one register per value
+	const __m256d e1_dor1_01 = _mm256_permute2f128_pd(bins[0], bins[1], 0x20); // e1 dor1 of lanes 0, 1
+	const __m256d e2_dor2_01 = _mm256_permute2f128_pd(bins[0], bins[1], 0x31);
+	const __m256d e1_dor1_23 = _mm256_permute2f128_pd(bins[2], bins[3], 0x20);
+	const __m256d e2_dor2_23 = _mm256_permute2f128_pd(bins[2], bins[3], 0x31);
+	const __m256d e1   = _mm256_permute4x64_pd(_mm256_unpacklo_pd(e1_dor1_01, e1_dor1_23), 0xd8);
+	const __m256d dor1 = _mm256_permute4x64_pd(_mm256_unpackhi_pd(e1_dor1_01, e1_dor1_23), 0xd8);
+	const __m256d e2   = _mm256_permute4x64_pd(_mm256_unpacklo_pd(e2_dor2_01, e2_dor2_23), 0xd8);
+	const __m256d dor2 = _mm256_permute4x64_pd(_mm256_unpackhi_pd(e2_dor2_01, e2_dor2_23), 0xd8);
+
+	const __m256d r2f = _mm256_loadu_pd(r2_factored);
+	const __m256d rem = _mm256_sub_pd(r2f, _mm256_round_pd(r2f, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC)); // r2_factored - sz(r2_factored), r2_factored >= 0
+	_mm256_storeu_pd(energies, _mm256_add_pd(e1,   _mm256_mul_pd(rem, _mm256_sub_pd(e2,   e1))));
+	_mm256_storeu_pd(dors,     _mm256_add_pd(dor1, _mm256_mul_pd(rem, _mm256_sub_pd(dor2, dor1))));
+}
+
+bool precalculate::simd = avx2_supported();
+
+#else
+
+void precalculate::eval_deriv_avx2(const sz* type_pair_indices, const fl* r2s, fl* energies, fl* dors) const {
+	VINA_CHECK(false); // never called, simd stays false
+}
+
+bool precalculate::simd = false;
+
+#endif
@@ -21,7 +21,6 @@
 */
 
 #include "quasi_newton.h"
-#include "bfgs.h"
 
 struct quasi_newton_aux {
 	model* m;
@@ -36,8 +35,15 @@ struct quasi_newton_aux {
 };
 
 void quasi_newton::operator()(model& m, const precalculate& p, const igrid& ig, output_type& out, change& g, const vec& v) const { // g must have correct size
+	quasi_newton_workspace w = workspace(out.c, g);
+	this->operator()(m, p, ig, out, g, v, w);
+}
+
+void quasi_newton::operator()(model& m, const precalculate& p, const igrid& ig, output_type& out, change& g, const vec& v, quasi_newton_workspace& w) const { // g must have correct size
 	quasi_newton_aux aux(&m, &p, &ig, v);
-	fl res = bfgs(aux, out.c, g, max_steps, average_required_improvement, 10);
+	VINA_CHECK(w.history() == lbfgs_history);
+	fl res = (lbfgs_history > 0) ? lbfgs(aux, out.c, g, w, max_steps, average_required_improvement, 10)
+	                             : bfgs (aux, out.c, g, w, max_steps, average_required_improvement, 10);
 	out.e = res;
 }
 
@@ -8,6 +8,6 @@
 
 #include "std-out.hh"
 
-vina_std_out_t vina_std_outs = vina_std_out_t();
-std::ostringstream &vina_std_out = vina_std_outs.std_out;
-std::ostringstream &vina_std_err = vina_std_outs.std_err;
+thread_local vina_std_out_t vina_std_outs = vina_std_out_t();
+thread_local std::ostringstream &vina_std_out = vina_std_outs.std_out;
+thread_local std::ostringstream &vina_std_err = vina_std_outs.std_err;
@@ -20,9 +20,10 @@ struct vina_std_out_t {
     }
 };
 
-extern vina_std_out_t vina_std_outs;
+// One pair of sinks per thread, so that concurrent runs don't mix their output
+extern thread_local vina_std_out_t vina_std_outs;
 
-extern std::ostringstream &vina_std_out;
-extern std::ostringstream &vina_std_err;
+extern thread_local std::ostringstream &vina_std_out;
+extern thread_local std::ostringstream &vina_std_err;
 
 #endif
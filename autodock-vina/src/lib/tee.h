@@ -28,12 +28,17 @@
 #include "file.h"
 
 struct tee {
-	ofile* of;
-	tee() : of(NULL) {}
+	std::ostream* of;
+	ofile* owned;
+	tee() : of(NULL), owned(NULL) {}
 	void init(const path& name) {
-		of = new ofile(name);
+		owned = new ofile(name);
+		of = owned;
 	}
-	virtual ~tee() { delete of; }
+	void init(std::ostream& out) { // out must outlive the tee
+		of = &out;
+	}
+	virtual ~tee() { delete owned; }
 	void flush() {
 		vina_std_out << std::flush;
 		if(of)
@@ -54,6 +59,12 @@ struct tee {
 		if(of)
 			of->setf(a, b);
 	}
+	std::streamsize precision(std::streamsize p) { // returns the previous one
+		std::streamsize old = vina_std_out.precision(p);
+		if(of)
+			of->precision(p);
+		return old;
+	}
 };
 
 template<typename T>
@@ -0,0 +1,216 @@
+/*
+
+   Copyright (c) 2006-2010, The Scripps Research Institute
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+   Author: Dr. Oleg Trott <ot14@columbia.edu>, 
+           The Olson Lab, 
+           The Scripps Research Institute
+
+*/
+
+#include "thread_pool.h"
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+std::vector<int> allowed_cores() {
+	std::vector<int> cores;
+#ifdef __linux__
+	cpu_set_t allowed;
+	CPU_ZERO(&allowed);
+	if(sched_getaffinity(0, sizeof(allowed), &allowed) == 0)
+		VINA_FOR(c, CPU_SETSIZE)
+			if(CPU_ISSET(c, &allowed))
+				cores.push_back(int(c));
+#endif
+	return cores;
+}
+
+void pin_thread(boost::thread& t, int core) {
+#ifdef __linux__
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(core, &set);
+	pthread_setaffinity_np(t.native_handle(), sizeof(set), &set);
+#endif
+}
+
+thread_pool& thread_pool::instance() {
+	static thread_pool pool;
+	return pool;
+}
+
+thread_pool::thread_pool() : workers(max_workers), m_size(0), demand(0), epoch(0), destructing(false), pinned(false) {}
+
+thread_pool::~thread_pool() {
+	{
+		boost::mutex::scoped_lock self_lk(self);
+		destructing = true;
+		cond.notify_all(); // destructing modified
+	}
+	VINA_FOR(i, m_size)
+		workers[i].thread.join();
+}
+
+void thread_pool::pin_threads() {
+	boost::mutex::scoped_lock self_lk(self);
+	if(pinned) return;
+	pinned = true;
+	cores = allowed_cores();
+	VINA_FOR(i, m_size)
+		pin(i);
+}
+
+void thread_pool::pin(sz index) { // self must be locked
+	if(cores.empty()) return;
+	pin_thread(workers[index].thread, cores[index % cores.size()]);
+}
+
+void thread_pool::grow(sz num_workers) {
+	if(num_workers > max_workers) num_workers = max_workers;
+	if(m_size >= num_workers) return;
+	boost::mutex::scoped_lock self_lk(self);
+	while(m_size < num_workers) {
+		const sz index = m_size;
+		workers[index].thread = boost::thread(aux(this, index));
+		if(pinned)
+			pin(index);
+		++m_size;
+	}
+}
+
+void thread_pool::run(loop& l, sz num_threads) {
+	grow(demand += l.limit); // the calling thread is one of the num_threads
+	push(max_workers, range(&l, 0, l.remaining));
+	range r;
+	while(l.remaining > 0 && take(max_workers, r, &l)) // helps with its own loop only, so that it returns as soon as the loop is done
+		execute(max_workers, r);
+	{
+		boost::mutex::scoped_lock l_lk(l.self);
+		while(l.remaining > 0 || l.joined > 0) // the threads that joined still refer to l
+			l.done.wait(l_lk);
+	}
+	demand -= l.limit;
+	if(l.error)
+		std::rethrow_exception(l.error);
+}
+
+void thread_pool::push(sz index, const range& r) {
+	if(index < max_workers) {
+		boost::mutex::scoped_lock worker_lk(workers[index].self);
+		workers[index].tasks.push_back(r);
+	}
+	const bool joinable = r.l->joined < r.l->limit; // otherwise only the threads in the loop take it
+	boost::mutex::scoped_lock self_lk(self); // a thread going to sleep has read the epoch by now
+	if(index >= max_workers)
+		injected.push_back(r);
+	++epoch;
+	if(joinable)
+		cond.notify_one();
+}
+
+bool thread_pool::take(sz index, range& r, const loop* only) {
+	if(index < max_workers) { // the newest range of its own, the smallest
+		worker& w = workers[index];
+		boost::mutex::scoped_lock worker_lk(w.self);
+		if(!w.tasks.empty()) { // of the loop it is in
+			r = w.tasks.back();
+			w.tasks.pop_back();
+			return true;
+		}
+	}
+	{
+		boost::mutex::scoped_lock self_lk(self);
+		VINA_FOR_IN(i, injected)
+			if(only ? injected[i].l == only : join(*injected[i].l)) {
+				r = injected[i];
+				injected.erase(injected.begin() + i);
+				return true;
+			}
+	}
+	const sz n = m_size;
+	VINA_FOR(k, n) { // steals the oldest range of another thread, the largest
+		const sz victim = (index + 1 + k) % n;
+		if(victim == index) continue;
+		worker& w = workers[victim];
+		boost::mutex::scoped_lock worker_lk(w.self);
+		if(!w.tasks.empty() && (only ? w.tasks.front().l == only : join(*w.tasks.front().l))) {
+			r = w.tasks.front();
+			w.tasks.pop_front();
+			return true;
+		}
+	}
+	return false;
+}
+
+bool thread_pool::join(loop& l) { // l has a range queued, so it lives
+	sz n = l.joined;
+	while(n < l.limit)
+		if(l.joined.compare_exchange_weak(n, n + 1))
+			return true;
+	return false;
+}
+
+void thread_pool::leave(loop& l) {
+	{
+		boost::mutex::scoped_lock l_lk(l.self); // the last access to l, run returns once it is released
+		if(--l.joined == 0 && l.remaining == 0)
+			l.done.notify_all();
+	}
+	boost::mutex::scoped_lock self_lk(self);
+	++epoch;
+	cond.notify_all(); // a place in a loop is free
+}
+
+void thread_pool::execute(sz index, range r) {
+	while(r.end - r.begin > 1) { // leaves the upper half to the thieves
+		const sz mid = r.begin + (r.end - r.begin) / 2;
+		push(index, range(r.l, mid, r.end));
+		r.end = mid;
+	}
+	loop& l = *r.l;
+	std::exception_ptr error;
+	try {
+		l.f_call(l.f, r.begin);
+	}
+	catch(...) {
+		error = std::current_exception();
+	}
+	boost::mutex::scoped_lock l_lk(l.self); // l lives until run sees remaining == 0, which it only reads under this lock
+	if(error && !l.error)
+		l.error = error;
+	if(--l.remaining == 0 && l.joined == 0)
+		l.done.notify_all();
+}
+
+void thread_pool::work(sz index) {
+	while(true) {
+		const sz seen = epoch;
+		range r;
+		if(take(index, r, NULL)) { // joined r.l
+			loop* l = r.l;
+			do
+				execute(index, r);
+			while(take(index, r, l));
+			leave(*l);
+			continue;
+		}
+		boost::mutex::scoped_lock self_lk(self);
+		while(!destructing && epoch == seen)
+			cond.wait(self_lk);
+		if(destructing) return;
+	}
+}
@@ -0,0 +1,125 @@
+/*
+
+   Copyright (c) 2006-2010, The Scripps Research Institute
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+   Author: Dr. Oleg Trott <ot14@columbia.edu>, 
+           The Olson Lab, 
+           The Scripps Research Institute
+
+*/
+
+#ifndef VINA_THREAD_POOL_H
+#define VINA_THREAD_POOL_H
+
+#include <atomic>
+#include <deque>
+#include <exception>
+#include <vector>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition.hpp>
+#include "common.h"
+
+std::vector<int> allowed_cores(); // the cores the launcher left to this process, none where that is unknown
+void pin_thread(boost::thread& t, int core);
+
+// The threads of the process, started on first use and kept until exit; there are as many as the loops
+// running at once ask for besides their calling threads, so that loops run from several threads (the
+// slots of a worker) don't share theirs. A loop is queued as one range of indices, which the thread that
+// takes it halves until one index is left, leaving the upper halves in its own deque; idle threads steal
+// from the other end of the deques of the busy ones. A thread joins a loop only while fewer than
+// num_threads - 1 did, and works on it until none of its ranges is left.
+struct thread_pool {
+	static thread_pool& instance();
+	~thread_pool();
+
+	// calls f(i) for every i in [0, size) on up to num_threads threads, the calling one included, and returns once all
+	// the calls returned; rethrows the first exception thrown by f
+	template<typename F>
+	void run(sz size, sz num_threads, const F& f) {
+		if(size == 0) return;
+		if(num_threads <= 1 || size == 1) {
+			VINA_FOR(i, size)
+				f(i);
+			return;
+		}
+		loop l(&call<F>, &f, size, num_threads - 1);
+		run(l, num_threads);
+	}
+	void pin_threads(); // binds every thread to one of the cores the process may run on, the threads started later too
+	sz num_threads() const { return m_size; }
+private:
+	struct loop {
+		void (*f_call)(const void* f, sz i);
+		const void* f;
+		std::atomic<sz> remaining;
+		sz limit; // pool threads that may join, the calling thread aside
+		std::atomic<sz> joined;
+		std::exception_ptr error;
+		boost::mutex self;
+		boost::condition done; // remaining or joined reached 0
+		loop(void (*f_call_)(const void*, sz), const void* f_, sz size, sz limit_) : f_call(f_call_), f(f_), remaining(size), limit(limit_), joined(0) {}
+	};
+	struct range {
+		loop* l;
+		sz begin;
+		sz end;
+		range() : l(NULL), begin(0), end(0) {}
+		range(loop* l_, sz begin_, sz end_) : l(l_), begin(begin_), end(end_) {}
+	};
+	struct worker {
+		boost::mutex self;
+		std::deque<range> tasks;
+		boost::thread thread;
+	};
+	struct aux {
+		thread_pool* pool;
+		sz index;
+		aux(thread_pool* pool_, sz index_) : pool(pool_), index(index_) {}
+		void operator()() const { pool->work(index); }
+	};
+
+	enum { max_workers = 256 };
+
+	thread_pool();
+	thread_pool(const thread_pool&);
+	thread_pool& operator=(const thread_pool&);
+
+	template<typename F>
+	static void call(const void* f, sz i) { (*static_cast<const F*>(f))(i); }
+
+	void run(loop& l, sz num_threads);
+	void grow(sz num_workers);
+	void pin(sz index);
+	void push(sz index, const range& r); // index == max_workers: the calling thread, which has no deque
+	bool take(sz index, range& r, const loop* only); // only: the loop to take from, NULL for any loop the thread may join
+	static bool join(loop& l);
+	void leave(loop& l);
+	void execute(sz index, range r);
+	void work(sz index);
+
+	std::vector<worker> workers; // max_workers of them, the first m_size are started
+	std::atomic<sz> m_size;
+	std::deque<range> injected; // the loops queued by threads outside the pool
+	std::atomic<sz> demand; // threads asked for by the running loops, their calling threads aside
+	std::atomic<sz> epoch; // incremented under self when a range is queued or a thread leaves a loop
+	bool destructing;
+	bool pinned;
+	std::vector<int> cores;
+	boost::mutex self; // guards injected, destructing, pinned, cores, the thread creation and the epoch increments
+	boost::condition cond;
+};
+
+#endif
@@ -26,16 +26,23 @@
 #include <string>
 #include <exception>
 #include <vector> // ligand paths
+#include <sstream> // ligand contents
 #include <cmath> // for ceila
 #include <boost/program_options.hpp>
 #include <boost/filesystem/fstream.hpp>
 #include <boost/filesystem/exception.hpp>
 #include <boost/filesystem/convenience.hpp> // filesystem::basename
+#include <boost/filesystem/operations.hpp> // exists, create_directories
+#include <boost/scoped_ptr.hpp>
 #include <boost/thread/thread.hpp> // hardware_concurrency // FIXME rm ?
+#include <boost/thread/mutex.hpp>
 #include "parse_pdbqt.h"
 #include "parallel_mc.h"
+#include "mc_scheduler.h"
+#include "thread_pool.h"
 #include "file.h"
 #include "cache.h"
+#include "grid_map.h"
 #include "non_cache.h"
 #include "naive_non_cache.h"
 #include "parse_error.h"
@@ -74,10 +81,23 @@ std::string default_output(const std::string& input_name) {
 
 void write_all_output(model& m, const output_container& out, sz how_many,
         const std::string& output_name,
-        const std::vector<std::string>& remarks) {
+        const std::vector<std::string>& remarks, __vina__::vina_result_t* result) {
     if(out.size() < how_many)
         how_many = out.size();
     VINA_CHECK(how_many <= remarks.size());
+    if(result) {
+        result->modes = int(how_many);
+        result->best_energy = (how_many > 0) ? out[0].e : 0;
+    }
+    if(result && result->keep_models) {
+        std::ostringstream models;
+        VINA_FOR(i, how_many) {
+            m.set(out[i].c);
+            m.write_model(models, i+1, remarks[i]);
+        }
+        result->models = models.str();
+        return;
+    }
     ofile f(make_path(output_name));
     VINA_FOR(i, how_many) {
         m.set(out[i].c);
@@ -87,7 +107,8 @@ void write_all_output(model& m, const output_container& out, sz how_many,
 
 void do_randomization(model& m,
         const std::string& out_name,
-        const vec& corner1, const vec& corner2, int seed, int verbosity, tee& log) {
+        const vec& corner1, const vec& corner2, int seed, int verbosity, tee& log,
+        __vina__::vina_result_t* result = NULL) {
     conf init_conf = m.get_initial_conf();
     rng generator(static_cast<rng::result_type>(seed));
     if(verbosity > 1) {
@@ -112,13 +133,22 @@ void do_randomization(model& m,
         log << "Clash penalty: " << best_clash_penalty; // FIXME rm?
         log.endl();
     }
+    if(result)
+        result->modes = 1;
+    if(result && result->keep_models) {
+        std::ostringstream structure;
+        m.write_structure(structure);
+        result->models = structure.str();
+        return;
+    }
     m.write_structure(make_path(out_name));
 }
 
-void refine_structure(model& m, const precalculate& prec, non_cache& nc, output_type& out, const vec& cap, sz max_steps = 1000) {
+void refine_structure(model& m, const precalculate& prec, non_cache& nc, output_type& out, const vec& cap, sz max_steps = 1000, sz lbfgs_history = 0) {
     change g(m.get_size());
     quasi_newton quasi_newton_par;
     quasi_newton_par.max_steps = max_steps;
+    quasi_newton_par.lbfgs_history = lbfgs_history;
     const fl slope_orig = nc.slope;
     VINA_FOR(p, 5) {
         nc.slope = 100 * std::pow(10.0, 2.0*p);
@@ -152,11 +182,29 @@ output_container remove_redundant(const output_container& in, fl min_rmsd) {
     return tmp;
 }
 
+struct grid_validation { // compares the grid energy of the docked poses against reference grids
+    const igrid* grids;
+    const igrid* reference;
+    fl max_deviation;
+    sz poses;
+    boost::mutex mutex; // concurrent runs of a session share it
+    grid_validation() : grids(NULL), reference(NULL), max_deviation(0), poses(0) {}
+    fl operator()(const model& m, fl v) { // returns the deviation of this pose
+        VINA_CHECK(grids && reference);
+        const fl deviation = std::abs(grids->eval(m, v) - reference->eval(m, v));
+        boost::mutex::scoped_lock lock(mutex);
+        max_deviation = (std::max)(max_deviation, deviation);
+        ++poses;
+        return deviation;
+    }
+};
+
 void do_search(model& m, const boost::optional<model>& ref, const scoring_function& sf, const precalculate& prec, const igrid& ig, const precalculate& prec_widened, const igrid& ig_widened, non_cache& nc, // nc.slope is changed
         const std::string& out_name,
         const vec& corner1, const vec& corner2,
         const parallel_mc& par, fl energy_range, sz num_modes,
-        int seed, int verbosity, bool score_only, bool local_only, tee& log, const terms& t, const flv& weights) {
+        int seed, int verbosity, bool score_only, bool local_only, tee& log, const terms& t, const flv& weights,
+        grid_validation* validation = NULL, __vina__::vina_result_t* result = NULL) {
     conf_size s = m.get_size();
     conf c = m.get_initial_conf();
     fl e = max_fl;
@@ -165,6 +213,8 @@ void do_search(model& m, const boost::optional<model>& ref, const scoring_functi
         fl intramolecular_energy = m.eval_intramolecular(prec, authentic_v, c);
         naive_non_cache nnc(&prec); // for out of grid issues
         e = m.eval_adjusted(sf, prec, nnc, authentic_v, c, intramolecular_energy);
+        if(result)
+            result->best_energy = e;
         log << "Affinity: " << std::fixed << std::setprecision(5) << e << " (kcal/mol)";
         log.endl();
         flv term_values = t.evale_robust(m);
@@ -190,7 +240,7 @@ void do_search(model& m, const boost::optional<model>& ref, const scoring_functi
     else if(local_only) {
         output_type out(c, e);
         doing(verbosity, "Performing local search", log);
-        refine_structure(m, prec, nc, out, authentic_v, par.mc.ssd_par.evals);
+        refine_structure(m, prec, nc, out, authentic_v, par.mc.ssd_par.evals, par.mc.lbfgs_history);
         done(verbosity, log);
         fl intramolecular_energy = m.eval_intramolecular(prec, authentic_v, out.c);
         e = m.eval_adjusted(sf, prec, nc, authentic_v, out.c, intramolecular_energy);
@@ -204,7 +254,7 @@ void do_search(model& m, const boost::optional<model>& ref, const scoring_functi
         output_container out_cont;
         out_cont.push_back(new output_type(out));
         std::vector<std::string> remarks(1, vina_remark(e, 0, 0));
-        write_all_output(m, out_cont, 1, out_name, remarks); // how_many == 1
+        write_all_output(m, out_cont, 1, out_name, remarks, result); // how_many == 1
         done(verbosity, log);
     }
     else {
@@ -218,7 +268,7 @@ void do_search(model& m, const boost::optional<model>& ref, const scoring_functi
 
         doing(verbosity, "Refining results", log);
         VINA_FOR_IN(i, out_cont)
-        refine_structure(m, prec, nc, out_cont[i], authentic_v, par.mc.ssd_par.evals);
+        refine_structure(m, prec, nc, out_cont[i], authentic_v, par.mc.ssd_par.evals, par.mc.lbfgs_history);
 
         if(!out_cont.empty()) {
             out_cont.sort();
@@ -264,9 +314,23 @@ void do_search(model& m, const boost::optional<model>& ref, const scoring_functi
             log.endl();
         }
         doing(verbosity, "Writing output", log);
-        write_all_output(m, out_cont, how_many, out_name, remarks);
+        write_all_output(m, out_cont, how_many, out_name, remarks, result);
         done(verbosity, log);
 
+        if(validation) {
+            fl deviation = 0;
+            VINA_FOR(i, how_many) {
+                m.set(out_cont[i].c);
+                deviation = (std::max)(deviation, (*validation)(m, authentic_v[0]));
+            }
+            std::streamsize precision = log.precision(3);
+            log << "Single precision grid maps, largest energy deviation over " << how_many << " modes: "
+                    << std::scientific << deviation << " (kcal/mol)";
+            log.endl();
+            log.setf(std::ios::fixed, std::ios::floatfield);
+            log.precision(precision);
+        }
+
         if(how_many < 1) {
             log << "WARNING: Could not find any conformations completely within the search space.\n"
                     << "WARNING: Check that it is large enough for all movable atoms, including those in the flexible side chains.";
@@ -275,25 +339,217 @@ void do_search(model& m, const boost::optional<model>& ref, const scoring_functi
     }
 }
 
-void main_procedure(model& m, const boost::optional<model>& ref, // m is non-const (FIXME?)
-        const std::string& out_name,
-        bool score_only, bool local_only, bool randomize_only, bool no_cache,
-        const grid_dims& gd, int exhaustiveness,
-        const flv& weights,
-        int cpu, int seed, int verbosity, sz num_modes, fl energy_range, tee& log) {
+const fl grid_slope = 1e6; // FIXME: too large? used to be 100
+const std::string scoring_function_version = "scoring_function_version001";
+
+model parse_bundle(const std::vector<std::string>& ligand_names);
+model parse_ligand(const std::string& ligand_name, const std::string& ligand_contents);
+model parse_bundle(const boost::optional<std::string>& rigid_name_opt, const boost::optional<std::string>& flex_name_opt, const std::vector<std::string>& ligand_names);
+
+grid_dims search_box(const __vina__::vina_args_t& args) {
+    grid_dims gd; // n's = 0 via default c'tor
+    if(!args.score_only) {
+        const fl granularity = 0.375;
+        vec span(args.size_x,   args.size_y,   args.size_z);
+        vec center(args.center_x, args.center_y, args.center_z);
+        VINA_FOR_IN(i, gd) {
+            gd[i].n = sz(std::ceil(span[i] / granularity));
+            fl real_span = granularity * gd[i].n;
+            gd[i].begin = center[i] - real_span/2;
+            gd[i].end = gd[i].begin + real_span;
+        }
+    }
+    return gd;
+}
+
+flv scoring_weights(const __vina__::vina_args_t& args) {
+    flv weights;
+    weights.push_back(args.weight_gauss1);
+    weights.push_back(args.weight_gauss2);
+    weights.push_back(args.weight_repulsion);
+    weights.push_back(args.weight_hydrophobic);
+    weights.push_back(args.weight_hydrogen);
+    weights.push_back(5 * args.weight_rot / 0.1 - 1); // linearly maps onto a different range, internally. see everything.cpp
+    return weights;
+}
 
-    doing(verbosity, "Setting up the scoring function", log);
+boost::optional<std::string> option_name(boost::program_options::variables_map& vm, const std::string& option, const std::string& name) {
+    boost::optional<std::string> tmp;
+    if(vm.count(option))
+        tmp = name;
+    return tmp;
+}
 
+namespace __vina__ {
+struct vina_session_data_t {
+    boost::optional<std::string> rigid_name;
+    boost::optional<std::string> flex_name;
+    grid_dims gd;
+    flv weights;
     everything t;
-    VINA_CHECK(weights.size() == 6);
+    weighted_terms wt;
+    precalculate prec;
+    precalculate prec_widened;
+    bool single_precision;
+    bool bricks;
+    cache c; // grids are populated lazily, only for the atom types seen so far
+    boost::mutex populate_mutex; // held while c and reference are populated, runs may share the session
+    boost::optional<model> receptor;
+    boost::scoped_ptr<grid_map> map; // backs the grids of c when they are memory-mapped
+    boost::scoped_ptr<cache> reference; // fl grids, only kept to validate single precision ones
+    grid_validation validation;
+
+    vina_session_data_t(const boost::optional<std::string>& rigid_name_, const boost::optional<std::string>& flex_name_,
+            const grid_dims& gd_, const flv& weights_, bool single_precision_, bool validate, bool bricks_)
+        : rigid_name(rigid_name_), flex_name(flex_name_), gd(gd_), weights(weights_), wt(&t, weights),
+          prec(wt), prec_widened(prec), single_precision(single_precision_), bricks(bricks_),
+          c(scoring_function_version, gd, grid_slope, atom_type::XS, single_precision, bricks) {
+        VINA_CHECK(weights.size() == 6);
+        const fl left  = 0.25;
+        const fl right = 0.25;
+        prec_widened.widen(left, right);
+        if(rigid_name)
+            receptor = parse_bundle(rigid_name, flex_name, std::vector<std::string>());
+        if(single_precision && validate) {
+            reference.reset(new cache(scoring_function_version, gd, grid_slope, atom_type::XS));
+            validation.grids = &c;
+            validation.reference = reference.get();
+        }
+    }
+    bool matches(const boost::optional<std::string>& rigid_name_, const boost::optional<std::string>& flex_name_,
+            const grid_dims& gd_, const flv& weights_, bool single_precision_, bool validate, bool bricks_) const {
+        return rigid_name == rigid_name_ && flex_name == flex_name_ && eq(gd, gd_) && eq(weights, weights_)
+                && single_precision == single_precision_ && bool(reference) == (single_precision_ && validate)
+                && bricks == bricks_;
+    }
+    model bundle(const std::string& ligand_name, const std::string& ligand_contents) const { // a copy of the receptor with the ligand appended
+        if(!receptor)
+            return parse_ligand(ligand_name, ligand_contents);
+        model tmp = receptor.get();
+        tmp.append(parse_ligand(ligand_name, ligand_contents));
+        return tmp;
+    }
+    void populate_all(int cpu) {
+        VINA_CHECK(receptor);
+        szv atom_types;
+        VINA_FOR(t, num_atom_types(prec.atom_typing_used()))
+            atom_types.push_back(t);
+        c.populate(receptor.get(), prec, atom_types, true, (cpu > 1) ? sz(cpu) : 1);
+    }
+    grid_map_key key() const { // identifies the grid maps, see grid_map.h
+        VINA_CHECK(rigid_name);
+        grid_map_key tmp;
+        tmp.add(scoring_function_version);
+        tmp.add(sz(prec.atom_typing_used()));
+        tmp.add(c.value_size());
+        tmp.add(sz(bricks));
+        tmp.add_file(make_path(rigid_name.get()));
+        tmp.add(gd);
+        VINA_FOR_IN(i, weights)
+            tmp.add(weights[i]);
+        return tmp;
+    }
+private:
+    vina_session_data_t(const vina_session_data_t&); // wt points to t
+    vina_session_data_t& operator=(const vina_session_data_t&);
+};
+
+vina_session_t::vina_session_t() {}
+
+vina_session_t::~vina_session_t() {}
+
+void vina_session_t::share_threads(int num_threads) {
+    if(num_threads > 0)
+        scheduler.reset(new mc_scheduler(sz(num_threads)));
+    else
+        scheduler.reset();
+}
+
+void vina_session_t::clear() {
+    data.reset();
+}
+
+bool vina_session_t::empty() const {
+    return !data;
+}
+
+bool vina_session_t::matches(variables_map &vm, const vina_args_t &args) const {
+    return data && data->matches(option_name(vm, "receptor", args.rigid_name), option_name(vm, "flex", args.flex_name),
+            search_box(args), scoring_weights(args), args.single_precision_grids, args.validate_grids, args.brick_grids);
+}
+
+void vina_session_t::init(variables_map &vm, const vina_args_t &args) {
+    clear();
+    data.reset(new vina_session_data_t(option_name(vm, "receptor", args.rigid_name), option_name(vm, "flex", args.flex_name),
+            search_box(args), scoring_weights(args), args.single_precision_grids, args.validate_grids, args.brick_grids));
+}
+
+size_t vina_session_t::grid_storage_size() const {
+    VINA_CHECK(data);
+    return data->c.storage_size();
+}
 
-    weighted_terms wt(&t, weights);
-    precalculate prec(wt);
-    const fl left  = 0.25;
-    const fl right = 0.25;
-    precalculate prec_widened(prec); prec_widened.widen(left, right);
+void vina_session_t::share_grids(void* storage, int cpu) {
+    VINA_CHECK(data && data->receptor);
+    data->populate_all(cpu);
+    data->c.move_to(storage);
+}
+
+void vina_session_t::attach_grids(const void* storage) {
+    VINA_CHECK(data);
+    data->c.attach(storage);
+}
 
-    done(verbosity, log);
+bool vina_session_t::map_grids(const std::string &directory, bool create, int cpu) {
+    VINA_CHECK(data && data->receptor);
+    const grid_map_key key = data->key();
+    const path name = make_path(directory) / (key.str() + ".grid");
+    if(boost::filesystem::exists(name)) {
+        try {
+            data->map.reset(new grid_map(name));
+            data->c.attach(*data->map, key);
+            return true;
+        }
+        catch(cache_mismatch&) { // written by an incompatible build
+            data->map.reset();
+        }
+    }
+    if(!create)
+        return false;
+    boost::filesystem::create_directories(make_path(directory));
+    data->populate_all(cpu);
+    data->c.write(name, key);
+    data->map.reset(new grid_map(name));
+    data->c.attach(*data->map, key);
+    return true;
+}
+
+bool vina_session_t::mapped_grids() const {
+    return data && data->map;
+}
+
+fl vina_session_t::grid_deviation() const {
+    return data ? data->validation.max_deviation : 0;
+}
+
+size_t vina_session_t::validated_poses() const {
+    return data ? data->validation.poses : 0;
+}
+}
+
+void main_procedure(model& m, const boost::optional<model>& ref, // m is non-const (FIXME?)
+        const std::string& out_name,
+        bool score_only, bool local_only, bool randomize_only, bool no_cache,
+        __vina__::vina_session_data_t& session, int exhaustiveness,
+        int cpu, int seed, int verbosity, sz num_modes, fl energy_range, sz lbfgs_history, mc_scheduler* scheduler,
+        __vina__::vina_result_t* result, tee& log) {
+
+    const grid_dims& gd = session.gd;
+    const flv& weights = session.weights;
+    const everything& t = session.t;
+    const weighted_terms& wt = session.wt;
+    const precalculate& prec = session.prec;
+    const precalculate& prec_widened = session.prec_widened;
 
     vec corner1(gd[0].begin, gd[1].begin, gd[2].begin);
     vec corner2(gd[0].end,   gd[1].end,   gd[2].end);
@@ -305,14 +561,16 @@ void main_procedure(model& m, const boost::optional<model>& ref, // m is non-con
     par.mc.min_rmsd = 1.0;
     par.mc.num_saved_mins = num_modes;
     par.mc.hunt_cap = vec(10, 10, 10);
+    par.mc.lbfgs_history = lbfgs_history;
     par.num_tasks = exhaustiveness;
     par.num_threads = cpu;
+    par.scheduler = scheduler;
     par.display_progress = (verbosity > 1);
 
-    const fl slope = 1e6; // FIXME: too large? used to be 100
+    const fl slope = grid_slope;
     if(randomize_only) {
         do_randomization(m, out_name,
-                corner1, corner2, seed, verbosity, log);
+                corner1, corner2, seed, verbosity, log, result);
     }
     else {
         non_cache nc        (m, gd, &prec,         slope); // if gd has 0 n's, this will not constrain anything
@@ -322,19 +580,24 @@ void main_procedure(model& m, const boost::optional<model>& ref, // m is non-con
                     out_name,
                     corner1, corner2,
                     par, energy_range, num_modes,
-                    seed, verbosity, score_only, local_only, log, t, weights);
+                    seed, verbosity, score_only, local_only, log, t, weights, NULL, result);
         }
         else {
             bool cache_needed = !(score_only || randomize_only || local_only);
             if(cache_needed) doing(verbosity, "Analyzing the binding site", log);
-            cache c("scoring_function_version001", gd, slope, atom_type::XS);
-            if(cache_needed) c.populate(m, prec, m.get_movable_atom_types(prec.atom_typing_used()));
+            cache& c = session.c;
+            if(cache_needed) {
+                boost::mutex::scoped_lock lock(session.populate_mutex);
+                c.populate(m, prec, m.get_movable_atom_types(prec.atom_typing_used()), true, cpu);
+                if(session.reference) session.reference->populate(m, prec, m.get_movable_atom_types(prec.atom_typing_used()), true, cpu);
+            }
             if(cache_needed) done(verbosity, log);
             do_search(m, ref, wt, prec, c, prec, c, nc,
                     out_name,
                     corner1, corner2,
                     par, energy_range, num_modes,
-                    seed, verbosity, score_only, local_only, log, t, weights);
+                    seed, verbosity, score_only, local_only, log, t, weights,
+                    session.reference ? &session.validation : NULL, result);
         }
     }
 }
@@ -388,6 +651,14 @@ model parse_bundle(const std::vector<std::string>& ligand_names) {
     return tmp;
 }
 
+// From the contents when the caller already read the file, the name then only labels the errors
+model parse_ligand(const std::string& ligand_name, const std::string& ligand_contents) {
+    if(ligand_contents.empty())
+        return parse_ligand_pdbqt(make_path(ligand_name));
+    std::istringstream in(ligand_contents);
+    return parse_ligand_pdbqt(in, make_path(ligand_name));
+}
+
 model parse_bundle(const boost::optional<std::string>& rigid_name_opt, const boost::optional<std::string>& flex_name_opt, const std::vector<std::string>& ligand_names) {
     if(rigid_name_opt)
         return parse_bundle(rigid_name_opt.get(), flex_name_opt, ligand_names);
@@ -427,6 +698,11 @@ void vina_options(vina_options_desc_t &desc, vina_options_desc_t &desc_config, v
                                 ("weight_hydrophobic", value<fl>(&args.weight_hydrophobic)->default_value(args.weight_hydrophobic), "hydrophobic weight")
                                 ("weight_hydrogen", value<fl>(&args.weight_hydrogen)->default_value(args.weight_hydrogen),          "Hydrogen bond weight")
                                 ("weight_rot", value<fl>(&args.weight_rot)->default_value(args.weight_rot),                         "N_rot weight")
+                                ("single_precision_grids", bool_switch(&args.single_precision_grids), "store the grid maps as float, energies are still accumulated in double")
+                                ("brick_grids", bool_switch(&args.brick_grids), "store the grid maps in 8x8x8 bricks, which keeps the corners of every cell in the same page")
+                                ("validate_grids", bool_switch(&args.validate_grids), "with single_precision_grids, also keep double grid maps and report the largest energy deviation of the docked modes")
+                                ("lbfgs_history", value<int>(&args.lbfgs_history)->default_value(0), "local optimization with L-BFGS keeping this many corrections, cheaper per step for many degrees of freedom (0: the dense BFGS)")
+                                ("pin_threads", bool_switch(&args.pin_threads), "bind the worker threads (the parallel loops and, with a shared Monte Carlo pool, its threads) to the cores the process may run on, one thread per core")
                                 ;
     options_description misc("Misc (optional)", 120);
     misc.add_options()
@@ -471,6 +747,13 @@ int parse_conf_options(vina_options_desc_t &desc_config, vina_options_desc_t &de
 
 int run(vina_options_desc_t &desc, vina_options_desc_t &desc_config, vina_options_desc_t &desc_simple,
         vina_options_desc_t &search_area, variables_map &vm, vina_args_t &args) {
+    vina_session_t session;
+    return run(desc, desc_config, desc_simple, search_area, vm, args, session);
+}
+
+int run(vina_options_desc_t &desc, vina_options_desc_t &desc_config, vina_options_desc_t &desc_simple,
+        vina_options_desc_t &search_area, variables_map &vm, vina_args_t &args, vina_session_t &session,
+        vina_result_t *result) {
     const std::string version_string = "AutoDock Vina 1.1.2 (" __DATE__ ")";
     const std::string error_message = "\n\n\
 Please contact the author, Dr. Oleg Trott <ot14@columbia.edu>, so\n\
@@ -504,6 +787,16 @@ Thank you!\n";
 #                                                               #\n\
 # Please see http://vina.scripps.edu for more information.      #\n\
 #################################################################\n";
+    // the log of a run with keep_log is handed over however the run ends
+    struct kept_log_t {
+        std::ostringstream contents;
+        __vina__::vina_result_t* result;
+        ~kept_log_t() {
+            if(result && result->keep_log)
+                result->log = contents.str();
+        }
+    } kept_log;
+    kept_log.result = result;
     try {
         if(args.version) {
             vina_std_out << version_string << '\n';
@@ -532,21 +825,17 @@ Thank you!\n";
             throw usage_error("exhaustiveness must be 1 or greater");
         if(args.num_modes < 1)
             throw usage_error("num_modes must be 1 or greater");
+        if(args.lbfgs_history < 0)
+            throw usage_error("lbfgs_history must be 0 or greater");
         sz max_modes_sz = static_cast<sz>(args.num_modes);
 
-        boost::optional<std::string> rigid_name_opt;
-        if(vm.count("receptor"))
-            rigid_name_opt = args.rigid_name;
-
-        boost::optional<std::string> flex_name_opt;
-        if(vm.count("flex"))
-            flex_name_opt = args.flex_name;
-
         if(vm.count("flex") && !vm.count("receptor"))
             throw usage_error("Flexible side chains are not allowed without the rest of the receptor"); // that's the only way parsing works, actually
 
         tee log;
-        if(!args.log_name.empty())
+        if(result && result->keep_log)
+            log.init(kept_log.contents);
+        else if(!args.log_name.empty())
             log.init(args.log_name);
 
         if(search_box_needed) {
@@ -573,27 +862,6 @@ Thank you!\n";
 //            }
         }
 
-        grid_dims gd; // n's = 0 via default c'tor
-
-        flv weights;
-        weights.push_back(args.weight_gauss1);
-        weights.push_back(args.weight_gauss2);
-        weights.push_back(args.weight_repulsion);
-        weights.push_back(args.weight_hydrophobic);
-        weights.push_back(args.weight_hydrogen);
-        weights.push_back(5 * args.weight_rot / 0.1 - 1); // linearly maps onto a different range, internally. see everything.cpp
-
-        if(search_box_needed) {
-            const fl granularity = 0.375;
-            vec span(args.size_x,   args.size_y,   args.size_z);
-            vec center(args.center_x, args.center_y, args.center_z);
-            VINA_FOR_IN(i, gd) {
-                gd[i].n = sz(std::ceil(span[i] / granularity));
-                fl real_span = granularity * gd[i].n;
-                gd[i].begin = center[i] - real_span/2;
-                gd[i].end = gd[i].begin + real_span;
-            }
-        }
         if(vm.count("cpu") == 0) {
             unsigned num_cpus = boost::thread::hardware_concurrency();
             if(args.verbosity > 1) {
@@ -609,12 +877,26 @@ Thank you!\n";
         }
         if(args.cpu < 1)
             args.cpu = 1;
+        if(args.pin_threads) {
+            thread_pool::instance().pin_threads();
+            if(session.scheduler)
+                session.scheduler->pin_threads();
+        }
         if(args.verbosity > 1 && args.exhaustiveness < args.cpu)
             log << "WARNING: at low exhaustiveness, it may be impossible to utilize all CPUs\n";
 
+        {
+            std::lock_guard<std::mutex> lock(session.init_mutex);
+            if(!session.matches(vm, args)) {
+                doing(args.verbosity, "Setting up the scoring function", log);
+                session.init(vm, args);
+                done(args.verbosity, log);
+            }
+        }
+
         doing(args.verbosity, "Reading input", log);
 
-        model m       = parse_bundle(rigid_name_opt, flex_name_opt, std::vector<std::string>(1, args.ligand_name));
+        model m       = session.data->bundle(args.ligand_name, args.ligand_contents);
 
         boost::optional<model> ref;
         done(args.verbosity, log);
@@ -622,9 +904,9 @@ Thank you!\n";
         main_procedure(m, ref,
                 args.out_name,
                 args.score_only, args.local_only, args.randomize_only, false, // no_cache == false
-                gd, args.exhaustiveness,
-                weights,
-                args.cpu, args.seed, args.verbosity, max_modes_sz, args.energy_range, log);
+                *session.data, args.exhaustiveness,
+                args.cpu, args.seed, args.verbosity, max_modes_sz, args.energy_range, sz(args.lbfgs_history),
+                session.scheduler.get(), result, log);
     }
     catch(file_error& e) {
         vina_std_err << "\n\nError: could not open \"" << e.name.filename() << "\" for " << (e.in ? "reading" : "writing") << ".\n";
@@ -23,11 +23,15 @@
 #ifndef __VINA_HH__
 #define __VINA_HH__
 
+#include <memory>
+#include <mutex>
 #include <string>
 #include <boost/program_options.hpp>
 #include "std-out.hh"
 #include "common.h"
 
+struct mc_scheduler;
+
 namespace __vina__ {
 using vina_options_desc_t = boost::program_options::options_description;
 using variables_map = boost::program_options::variables_map;
@@ -47,6 +51,59 @@ struct vina_args_t {
     fl weight_rot = 0.05846;
     bool score_only = false, local_only = false, randomize_only = false, help = false,
             help_advanced = false, version = false, ligand_Q = false;
+    bool single_precision_grids = false, validate_grids = false, brick_grids = false, pin_threads = false;
+    int lbfgs_history = 0;
+    std::string ligand_contents; // the PDBQT of ligand_name, when set it is parsed instead of the file
+};
+
+// What a run produced: the affinity of the best mode and the number of modes written. With keep_models
+// the output PDBQT is left in models instead of being written to out_name, with keep_log the log is left
+// in log instead of being written to log_name, also when the run fails
+struct vina_result_t {
+    bool keep_models = false;
+    bool keep_log = false;
+    std::string models;
+    std::string log;
+    fl best_energy = 0;
+    int modes = 0;
+};
+
+// Receptor, scoring function and grid maps shared by consecutive runs, defined in vina.cxx
+struct vina_session_data_t;
+
+// Keeps the parsed receptor and the grid maps alive between calls to run, they are rebuilt only
+// when the receptor, the search box or the weights change. Runs on several threads may share a
+// session as long as they agree on those, the grid maps are then populated by one run at a time
+class vina_session_t {
+public:
+    vina_session_t();
+    ~vina_session_t();
+    vina_session_t(const vina_session_t&) = delete;
+    vina_session_t& operator=(const vina_session_t&) = delete;
+
+    void clear();
+    bool empty() const;
+    bool matches(variables_map &vm, const vina_args_t &args) const;
+    void init(variables_map &vm, const vina_args_t &args); // parses the receptor, grids are populated lazily
+
+    size_t grid_storage_size() const; // number of bytes holding the grid maps of every atom type
+    void share_grids(void *storage, int cpu = 1); // populates every grid map using cpu threads and moves them into storage
+    void attach_grids(const void *storage); // reads every grid map from storage, filled elsewhere by share_grids
+    // memory-maps the grid maps cached in directory, keyed by the receptor contents, the search box, the weights and
+    // the scoring function version; when they are missing and create is set they are populated using cpu threads and written
+    bool map_grids(const std::string &directory, bool create, int cpu = 1);
+    bool mapped_grids() const;
+    // with validate_grids, the largest deviation of the single precision grid energy from the double one, over the
+    // docked poses of every ligand run in this session
+    fl grid_deviation() const;
+    size_t validated_poses() const;
+    // runs the Monte Carlo chains of every run of the session, concurrent ones included, on one pool of num_threads
+    // threads in submission order, rather than on --cpu threads started by every run (0: the latter)
+    void share_threads(int num_threads);
+
+    std::unique_ptr<vina_session_data_t> data;
+    std::unique_ptr<mc_scheduler> scheduler;
+    std::mutex init_mutex; // held by run while it checks and sets up the session
 };
 
 void vina_options(vina_options_desc_t &desc, vina_options_desc_t &desc_config, vina_options_desc_t &desc_simple,
@@ -57,5 +114,9 @@ int parse_conf_options(vina_options_desc_t &desc_config, vina_options_desc_t &de
 
 int run(vina_options_desc_t &desc, vina_options_desc_t &desc_config, vina_options_desc_t &desc_simple,
         vina_options_desc_t &search_area, variables_map &vm, vina_args_t &args);
+
+int run(vina_options_desc_t &desc, vina_options_desc_t &desc_config, vina_options_desc_t &desc_simple,
+        vina_options_desc_t &search_area, variables_map &vm, vina_args_t &args, vina_session_t &session,
+        vina_result_t *result = nullptr);
 }
 #endif
@@ -6,6 +6,7 @@
 // Description :
 //============================================================================
 
+#include <atomic>
 #include <chrono>
 #include <iostream>
 #include "vina-mpi/mpi_batch.hh"
@@ -14,12 +15,38 @@ using namespace std;
 
 void master(MPIBatch::options_t &opts) {
     using namespace MPIBatch;
-    std::vector <std::string> pdbqts = init_vina_files(opts);
+    LigandSource ligands(opts.vm["vina-ligand-dir"].as <std::string>());
+    init_dirs(opts);
     try {
+        LigandPrefetcher prefetcher;
         StringSerializer serializer;
-        MasterProcess <task_queue <std::string>, ServerMode::autocontained> master;
-        if (!pdbqts.empty())
-            master.queue().insert(pdbqts.begin(), pdbqts.end());
+        PayloadSerializer payload_serializer;
+        if (opts.vm["ligand-payload"].as <bool>()) {
+            prefetcher.start(prefetch_capacity);
+            payload_serializer.set_prefetcher(&prefetcher);
+        }
+        MasterProcess <dense_task_queue <std::string>, ServerMode::autocontained> master;
+        LigandCostModel cost_model;
+        if (opts.vm["longest-first"].as <bool>()) {
+            master.queue().set_priority([&cost_model](const std::string &ligand) {
+                return cost_model.estimate(ligand);
+            });
+            master.set_batch_observer([&cost_model, &master](const std::vector <std::string*> &ligands, duration time) {
+                if (cost_model.observe(ligands, time))
+                    master.queue().reprioritize();
+            });
+        }
+        size_t top = static_cast <size_t>(std::max(opts.vm["top"].as <int>(), 0));
+        bool top_modelsQ = opts.vm["top-models"].as <bool>();
+        LigandRanking ranking(top, top_modelsQ);
+        if (top > 0)
+            master.set_result_observer([&ranking](std::string *ligand, int64_t task_id, task_result_t &result) {
+                ranking.add(*ligand, task_id, result);
+            });
+        if (top > 0 && top_modelsQ)
+            master.set_reply_bound([&ranking]() {
+                return affinity_bound(ranking.bound());
+            });
         if (opts.vm.count("mpi-log-dir") > 0) {
             std::filesystem::path log_dir = std::filesystem::path(
                     opts.vm["mpi-log-dir"].as <std::string>()).string();
@@ -27,11 +54,98 @@ void master(MPIBatch::options_t &opts) {
                     + ".log";
             master.logger().open(log_dir.string());
         }
+        TaskJournal journal;
+        if (opts.vm.count("journal") > 0) {
+            journal.open(opts.vm["journal"].as <std::string>());
+            if (!journal.completed().empty())
+                master.logger()(LogType::info, "Resuming from the journal, ", journal.completed().size(),
+                        " ligands already docked, ", journal.interrupted(), " were interrupted");
+            master.set_journal(&journal);
+        }
+        bool skip_existing = opts.vm["skip-existing"].as <bool>();
+        bool shardQ = opts.vm["shard-output"].as <bool>();
+        std::string out_dir = opts.vm["vina-out-dir"].as <std::string>();
+        // A ligand is journaled once docked, possibly before the background writer or the shard buffer of
+        // its worker wrote it, so with either the journaled ligands are docked again if their outputs are
+        // incomplete
+        bool check_journal = skip_existing || shardQ || opts.vm["write-queue"].as <int>() > 0;
+        std::unordered_set <std::string> sharded;
+        if (check_journal && shardQ)
+            sharded = shard_ligands(out_dir);
+        if (journal.is_open() || skip_existing)
+            ligands.set_filter([&opts, &journal, &sharded, skip_existing, check_journal, shardQ](
+                    const std::string &ligand) {
+                bool journaled = journal.is_open() && journal.completed().count(ligand) > 0;
+                if (journaled && !check_journal)
+                    return false;
+                if (!journaled && !skip_existing)
+                    return true;
+                if (shardQ)
+                    return sharded.count(ligand_name(ligand)) == 0;
+                return !complete_pdbqt(vina_out_path(opts, ligand));
+            });
+        master.queue().set_source([&ligands, &prefetcher](std::string &ligand) {
+            if (!ligands.next(ligand))
+                return false;
+            prefetcher.push(ligand);
+            return true;
+        }, static_cast <size_t>(std::max(opts.vm["queue-window"].as <int>(), 1)));
+        if (opts.vm.count("grid-map-dir") > 0) {
+            std::string grid_map_dir = opts.vm["grid-map-dir"].as <std::string>();
+            try {
+                __vina__::vina_session_t session;
+                time_point start = now();
+                session.init(opts.vm_vina, opts.vina_opts.args);
+                session.map_grids(grid_map_dir, true, opts.vina_opts.args.cpu);
+                master.logger()(LogType::info, "Grid maps ready in ", grid_map_dir, ", elapsed time: ",
+                        display_duration(elapsed(now(), start)));
+            } catch (...) {
+                master.logger()(LogType::warn, "Couldn't precompute the grid maps in ", grid_map_dir);
+            }
+            mpi_error <true>(master.logger(), MPI_Barrier(MPI_COMM_WORLD));
+        }
+        if (opts.vm["shared-grids"].as <bool>()) {
+            SharedGrids shared_grids;
+            shared_grids.init(master.logger(), MPI_COMM_WORLD, false);
+            mpi_error <true>(master.logger(), MPI_Barrier(MPI_COMM_WORLD));
+        }
+        master.set_batch_size(std::max(opts.vm["batch-size"].as <int>(), 1));
         int report = opts.vm["report-frequency"].as <int>();
         if (report < 0)
             report = 0;
         time_point start = now();
-        master.run(serializer, std::chrono::seconds(report));
+        if (opts.vm["ligand-payload"].as <bool>())
+            master.run(payload_serializer, std::chrono::seconds(report));
+        else
+            master.run(serializer, std::chrono::seconds(report));
+        if (ligands.skipped() > 0)
+            master.logger()(LogType::info, "Skipped ", ligands.skipped(), " of ", ligands.enumerated(),
+                    " ligands, docked by a previous run");
+        // Not fatal, the workers wait on the barrier of the shards below
+        if (top > 0) {
+            try {
+                std::string table = (std::filesystem::path(out_dir) / "top.tsv").string();
+                ranking.write(table, [](const std::string &ligand) {
+                    return ligand_name(ligand);
+                });
+                size_t models = ranking.write_models([&opts](const std::string &ligand) {
+                    return vina_out_path(opts, ligand);
+                });
+                master.logger()(LogType::info, "Ranked the best ", ranking.size(), " of ", ranking.reported(),
+                        " docked ligands in ", table, ", ", ranking.failed(), " failed");
+                if (models > 0)
+                    master.logger()(LogType::info, "Wrote the models of the ", models, " top ligands");
+            } catch (std::exception &exc) {
+                master.logger()(LogType::error, "Couldn't write the ranking: ", exc.what());
+            }
+        }
+        if (shardQ) {
+            // The workers flush their shards before the barrier
+            mpi_error <true>(master.logger(), MPI_Barrier(MPI_COMM_WORLD));
+            std::string table = (std::filesystem::path(out_dir) / "results.tsv").string();
+            size_t count = merge_shard_indexes(out_dir, table);
+            master.logger()(LogType::info, "Merged the shard indexes of ", count, " ligands into ", table);
+        }
         master.logger()(LogType::trace, "Total execution time: ", display_duration(elapsed(now(), start)));
         if (opts.vm.count("mpi-log-dir") > 0) {
             master.logger().close();
@@ -46,53 +160,88 @@ void worker(MPIBatch::options_t &opts) {
     bool outQ = opts.vm["std-out"].as <bool>();
     bool errQ = opts.vm["std-err"].as <bool>();
     bool logQ = opts.vm.count("vina-log-dir") > 0;
+    bool payloadQ = opts.vm["ligand-payload"].as <bool>();
+    bool shardQ = opts.vm["shard-output"].as <bool>();
+    size_t write_queue = static_cast <size_t>(std::max(opts.vm["write-queue"].as <int>(), 0)) << 20;
+    bool asyncQ = write_queue > 0;
+    bool top_modelsQ = opts.vm["top"].as <int>() > 0 && opts.vm["top-models"].as <bool>();
     std::string suffix;
     std::string receptor;
     if (opts.vm.count("vina-out-suffix") > 0)
         suffix = opts.vm["vina-out-suffix"].as <std::string>();
     if (opts.vm_vina.count("receptor") > 0)
         receptor = std::filesystem::path(opts.vina_opts.args.rigid_name).stem().string();
-    auto task = [&opts, outQ, errQ, logQ, suffix, receptor](Logger &logger, std::string str,
-            WorkerStatus *status) {
-        try {
-            std::filesystem::path out_path = std::filesystem::path(
-                    opts.vm["vina-out-dir"].as <std::string>());
-            std::filesystem::path ligand_path = std::filesystem::path(str);
-            std::string ligand_name = ligand_path.stem().string();
-            out_path /= ligand_name + suffix + ".pdbqt";
-            if (logQ) {
-                std::filesystem::path log_path = std::filesystem::path(
-                        opts.vm["vina-log-dir"].as <std::string>());
-                log_path /= ligand_name + suffix + ".log";
-                opts.vina_opts.args.log_name = log_path.string();
-            } else
-                opts.vina_opts.args.log_name = "";
-            opts.vina_opts.args.out_name = out_path.string();
-            opts.vina_opts.args.ligand_name = str;
-            std::string msg = "ligand: " + ligand_name;
-            if (!receptor.empty())
-                msg += " & receptor: " + receptor;
-            vina_std_out.str("");
-            vina_std_err.str("");
-            time_point start = now();
-            int err = __vina__::run(opts.vina_opts.desc, opts.vina_opts.desc_config,
-                    opts.vina_opts.desc_simple, opts.vina_opts.search_area, opts.vm_vina,
-                    opts.vina_opts.args);
-            duration eps = elapsed(now(), start);
-            if (err == 0) {
-                if (outQ) {
-                    logger(LogType::trace, "Vina stdout for ", msg, "\n", vina_std_out.str());
+    AsyncWriter writer; // outlives the shard and the logger, which hand their writes to it
+    SharedGrids shared_grids;
+    __vina__::vina_session_t session;
+    ShardWriter shard;
+    std::atomic <int> top_bound(no_bound); // the master's, only the models of the ligands within are sent
+    auto task = [&opts, &session, &shard, &writer, &top_bound, outQ, errQ, logQ, payloadQ, shardQ, asyncQ,
+            top_modelsQ, suffix, receptor](Logger &logger, std::vector <std::string> ligands) {
+        std::vector <task_result_t> results(ligands.size());
+        for (size_t i = 0; i < ligands.size(); ++i) {
+            const std::string &ligand = ligands[i];
+            results[i].status = -1;
+            try {
+                __vina__::vina_args_t args = opts.vina_opts.args; // every slot docks with its own copy
+                std::string str = ligand;
+                if (payloadQ)
+                    std::tie(str, args.ligand_contents) = PayloadSerializer::split(ligand);
+                ligand_ref_t ref = ligand_ref_t::parse(str);
+                if (ref.sliceQ() && args.ligand_contents.empty() && !read_ligand(str, args.ligand_contents))
+                    throw std::runtime_error("couldn't read " + ref.name + " from " + ref.path);
+                std::string ligand_name = MPIBatch::ligand_name(str);
+                if (logQ) {
+                    std::filesystem::path log_path = std::filesystem::path(
+                            opts.vm["vina-log-dir"].as <std::string>());
+                    log_path /= ligand_name + suffix + ".log";
+                    args.log_name = log_path.string();
+                } else
+                    args.log_name = "";
+                args.out_name = vina_out_path(opts, str);
+                args.ligand_name = ref.path;
+                std::string msg = "ligand: " + ligand_name;
+                if (!receptor.empty())
+                    msg += " & receptor: " + receptor;
+                vina_std_out.str("");
+                vina_std_err.str("");
+                __vina__::vina_result_t result;
+                result.keep_models = shardQ || asyncQ || top_modelsQ;
+                result.keep_log = asyncQ && logQ;
+                time_point start = now();
+                int err = __vina__::run(opts.vina_opts.desc, opts.vina_opts.desc_config,
+                        opts.vina_opts.desc_simple, opts.vina_opts.search_area, opts.vm_vina,
+                        args, session, &result);
+                duration eps = elapsed(now(), start);
+                results[i].status = err;
+                results[i].score = result.best_energy;
+                results[i].modes = result.modes;
+                results[i].seconds = eps.count();
+                if (result.keep_log)
+                    writer.write_file(args.log_name, std::move(result.log));
+                if (err == 0) {
+                    if (shardQ)
+                        shard.append(ligand_name, result.models, result.best_energy);
+                    if (top_modelsQ) {
+                        if (affinity_bound(result.best_energy) <= top_bound)
+                            results[i].payload = std::move(result.models);
+                    }
+                    else if (!shardQ && asyncQ && result.modes > 0)
+                        writer.write_file(args.out_name, std::move(result.models));
+                    if (outQ) {
+                        logger(LogType::trace, "Vina stdout for ", msg, "\n", vina_std_out.str());
+                    }
+                    logger(LogType::trace, "Execution time for ", msg, ": ", display_duration(eps));
+                } else {
+                    logger(LogType::warn, "Vina stderr for ", msg, "\n", vina_std_err.str());
                 }
-                logger(LogType::trace, "Execution time for ", msg, ": ", display_duration(eps));
-            } else {
-                logger(LogType::warn, "Vina stderr for ", msg, "\n", vina_std_err.str());
+            } catch (std::exception &exc) {
+                logger(LogType::error, "Vina unexpectedly failed, error message: ", exc.what());
             }
-        } catch (std::exception &exc) {
-            logger(LogType::error, "Vina unexpectedly failed, error message: ", exc.what());
         }
-        *status = WorkerStatus::finished;
+        return results;
     };
-    task_container <void(Logger&, std::string, WorkerStatus*)> container;
+    task_container <std::vector <task_result_t>(Logger&, std::vector <std::string>)> container;
     container.task = task;
     try {
         StringSerializer serializer;
@@ -105,7 +254,50 @@ void worker(MPIBatch::options_t &opts) {
             worker.logger().open(log_dir.string());
         }
         worker.logger().set_std_out(opts.vm["print-clients"].as <bool>());
-        worker.run(serializer, container);
+        if (top_modelsQ)
+            worker.set_bound_observer([&top_bound](int bound) {
+                top_bound = bound;
+            });
+        if (asyncQ) {
+            writer.start(write_queue);
+            worker.logger().set_writer(&writer);
+            shard.set_writer(&writer);
+        }
+        if (shardQ)
+            shard.open(opts.vm["vina-out-dir"].as <std::string>(),
+                    worker.logger().hostname() + "-" + std::to_string(worker.logger().rank()));
+        if (opts.vm.count("grid-map-dir") > 0) {
+            mpi_error <true>(worker.logger(), MPI_Barrier(MPI_COMM_WORLD));
+            try {
+                session.init(opts.vm_vina, opts.vina_opts.args);
+                if (!session.map_grids(opts.vm["grid-map-dir"].as <std::string>(), false))
+                    worker.logger()(LogType::warn, "Grid maps not found, they will be populated by the worker");
+            } catch (...) {
+                session.clear();
+            }
+        }
+        if (opts.vm["shared-grids"].as <bool>()) {
+            shared_grids.init(worker.logger(), MPI_COMM_WORLD, true);
+            if (session.empty()) {
+                try {
+                    session.init(opts.vm_vina, opts.vina_opts.args);
+                } catch (...) {
+                    session.clear();
+                }
+            }
+            shared_grids.share(session, opts.vina_opts.args.cpu);
+            mpi_error <true>(worker.logger(), MPI_Barrier(MPI_COMM_WORLD));
+        }
+        if (opts.vm["mc-threads"].as <int>() > 0)
+            session.share_threads(opts.vm["mc-threads"].as <int>());
+        worker.run(serializer, container, std::max(opts.vm["slots"].as <int>(), 1));
+        if (shardQ) {
+            shard.close();
+            mpi_error <true>(worker.logger(), MPI_Barrier(MPI_COMM_WORLD));
+        }
+        if (session.validated_poses() > 0)
+            worker.logger()(LogType::info, "Single precision grid maps, largest energy deviation over ",
+                    session.validated_poses(), " modes: ", session.grid_deviation(), " kcal/mol");
         if (opts.vm.count("mpi-log-dir") > 0) {
             worker.logger().close();
         }
@@ -61,7 +61,21 @@ void init(options_t& program_opts) {
         ("print-clients,p", po::bool_switch(), "print clients logs to stdout")
         ("mpi-log-dir,L",po::value <std::string>(), "directory to write the mpi logs")
         ("report-frequency,r", po::value <int>()->default_value(60), "print queue status every [r] seconds")
-        ("vina-ligand-dir,i",po::value <std::string>(), "directory containing the ligands in PDBQT format")
+        ("shared-grids,G", po::bool_switch(), "share the grid maps between the workers of a node (MPI-3 shared memory)")
+        ("grid-map-dir,M", po::value <std::string>(), "directory caching the grid maps, precomputed by the master and memory-mapped by the workers")
+        ("batch-size,b", po::value <int>()->default_value(1), "send up to [b] ligands per message, the batch adapts to the observed docking time")
+        ("longest-first,F", po::bool_switch(), "dispatch the ligands by decreasing estimated docking time, estimated from their atoms and torsions and refined with the measured times")
+        ("journal,J", po::value <std::string>(), "append the dispatched and docked ligands to this file, a run restarted with the same journal skips the ligands it records as docked")
+        ("skip-existing,K", po::bool_switch(), "skip the ligands whose output model (PDBQT) already exists and is complete, or is in a shard with --shard-output")
+        ("queue-window,W", po::value <int>()->default_value(100000), "keep up to [W] ligands queued on the master, the ligands are enumerated as the queue drains")
+        ("ligand-payload,P", po::bool_switch(), "the master reads the ligands ahead of their dispatch, from a background thread, and sends their contents to the workers, which then don't open the ligand files")
+        ("shard-output,H", po::bool_switch(), "every worker appends its output models to <vina-out-dir>/<host>-<rank>.shard.pdbqt, indexed in <host>-<rank>.shard.idx, instead of writing a PDBQT per ligand; the master merges the indexes into <vina-out-dir>/results.tsv, best affinity first")
+        ("write-queue,Q", po::value <int>()->default_value(0), "the workers write the output models and logs from a background thread, queuing up to [Q] MiB of them, the docking waits only when the queue is full (0: write them while docking); the journal may then run ahead of the outputs, a resumed run checks the outputs of the journaled ligands")
+        ("top,N", po::value <int>()->default_value(0), "rank the ligands by the best affinity the workers report and write the best [N] to <vina-out-dir>/top.tsv (0: no ranking)")
+        ("top-models,X", po::bool_switch(), "with --top, the workers send the output models of the ligands that can still enter the ranking to the master instead of writing them, the master writes the models (PDBQT) of the top ligands only, at the end of the run; not allowed with --journal")
+        ("slots,S", po::value <int>()->default_value(1), "dock up to [S] ligands at once on every worker, each on up to the vina --cpu threads, sharing the receptor, the grid maps and one thread pool of [S] x --cpu threads")
+        ("mc-threads,T", po::value <int>()->default_value(0), "run the Monte Carlo chains of all the slots of a worker on one pool of [T] threads, the next ligand fills the threads freed by the current one (0: every ligand runs its chains on up to vina --cpu threads of the thread pool)")
+        ("vina-ligand-dir,i",po::value <std::string>(), "directory containing the ligands in PDBQT format, or a file listing the ligands (PDBQT files or directories), one per line; a PDBQT file given or listed that is made of MODEL blocks is a library of ligands, indexed in <file>.idx")
         ("vina-out-dir,o",po::value <std::string>()->default_value("vina-models"), "directory to write the vina output models (PDBQT)")
         ("vina-log-dir,l",po::value <std::string>(), "directory to write the vina logs")
         ("vina-out-suffix,s",po::value <std::string>(), "output models (PDBQT) & logs suffix: <ligand-name><suffix>.pdbqt, <ligand-name><suffix>.log")
@@ -76,7 +90,21 @@ void init(options_t& program_opts) {
         ("print-clients,p", po::bool_switch(), "print clients logs to stdout")
         ("mpi-log-dir,L",po::value <std::string>(), "directory to write the mpi logs")
         ("report-frequency,r", po::value <int>()->default_value(60), "print queue status every [r] seconds")
-        ("vina-ligand-dir,i", po::value <std::string>(), "directory containing the ligands in PDBQT format")
+        ("shared-grids,G", po::bool_switch(), "share the grid maps between the workers of a node (MPI-3 shared memory)")
+        ("grid-map-dir,M", po::value <std::string>(), "directory caching the grid maps, precomputed by the master and memory-mapped by the workers")
+        ("batch-size,b", po::value <int>()->default_value(1), "send up to [b] ligands per message, the batch adapts to the observed docking time")
+        ("longest-first,F", po::bool_switch(), "dispatch the ligands by decreasing estimated docking time, estimated from their atoms and torsions and refined with the measured times")
+        ("journal,J", po::value <std::string>(), "append the dispatched and docked ligands to this file, a run restarted with the same journal skips the ligands it records as docked")
+        ("skip-existing,K", po::bool_switch(), "skip the ligands whose output model (PDBQT) already exists and is complete, or is in a shard with --shard-output")
+        ("queue-window,W", po::value <int>()->default_value(100000), "keep up to [W] ligands queued on the master, the ligands are enumerated as the queue drains")
+        ("ligand-payload,P", po::bool_switch(), "the master reads the ligands ahead of their dispatch, from a background thread, and sends their contents to the workers, which then don't open the ligand files")
+        ("shard-output,H", po::bool_switch(), "every worker appends its output models to <vina-out-dir>/<host>-<rank>.shard.pdbqt, indexed in <host>-<rank>.shard.idx, instead of writing a PDBQT per ligand; the master merges the indexes into <vina-out-dir>/results.tsv, best affinity first")
+        ("write-queue,Q", po::value <int>()->default_value(0), "the workers write the output models and logs from a background thread, queuing up to [Q] MiB of them, the docking waits only when the queue is full (0: write them while docking); the journal may then run ahead of the outputs, a resumed run checks the outputs of the journaled ligands")
+        ("top,N", po::value <int>()->default_value(0), "rank the ligands by the best affinity the workers report and write the best [N] to <vina-out-dir>/top.tsv (0: no ranking)")
+        ("top-models,X", po::bool_switch(), "with --top, the workers send the output models of the ligands that can still enter the ranking to the master instead of writing them, the master writes the models (PDBQT) of the top ligands only, at the end of the run; not allowed with --journal")
+        ("slots,S", po::value <int>()->default_value(1), "dock up to [S] ligands at once on every worker, each on up to the vina --cpu threads, sharing the receptor, the grid maps and one thread pool of [S] x --cpu threads")
+        ("mc-threads,T", po::value <int>()->default_value(0), "run the Monte Carlo chains of all the slots of a worker on one pool of [T] threads, the next ligand fills the threads freed by the current one (0: every ligand runs its chains on up to vina --cpu threads of the thread pool)")
+        ("vina-ligand-dir,i", po::value <std::string>(), "directory containing the ligands in PDBQT format, or a file listing the ligands (PDBQT files or directories), one per line; a PDBQT file given or listed that is made of MODEL blocks is a library of ligands, indexed in <file>.idx")
         ("vina-out-dir,o", po::value <std::string>()->default_value("vina-models"), "directory to write the vina output models (PDBQT)")
         ("vina-log-dir,l", po::value <std::string>(), "directory to write the vina logs")
         ("vina-out-suffix,s",po::value <std::string>(), "output models (PDBQT) & logs suffix: <ligand-name><suffix>.pdbqt, <ligand-name><suffix>.log");
@@ -112,6 +140,14 @@ int argument_parse(int argc, char *argv[], options_t &program_opts) {
             help(program_opts);
             return 1;
         }
+        // The models of the top ligands exist only in the master until the end of the run, an interrupted
+        // run would lose them while the journal records their ligands as docked
+        if (program_opts.vm["top"].as <int>() > 0 && program_opts.vm["top-models"].as <bool>()
+                && program_opts.vm.count("journal") > 0) {
+            std::cout << "Error, --top-models can't be used with --journal" << std::endl;
+            help(program_opts);
+            return 1;
+        }
         if (program_opts.vm.count("vina") > 0) {
             std::string cmd = program_opts.vm["vina"].as <std::string>();
             if (cmd == "vina") {
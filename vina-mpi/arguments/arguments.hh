@@ -30,7 +30,11 @@ struct options_t {
             boost::program_options::options_description("Vina MPI options", 120);
     boost::program_options::positional_options_description positional;
     const std::string usage =
-            "Usage: ./program [--help] [--mpi-log-dir <dir-path>] [--std-out] [--std-err] [--report-frequency num] \\\n"
+            "Usage: ./program [--help] [--mpi-log-dir <dir-path>] [--std-out] [--std-err] [--report-frequency num] [--shared-grids] \\\n"
+            "\t\t[--grid-map-dir <dir-path>] [--batch-size num] [--longest-first] \\\n"
+            "\t\t[--slots num] [--mc-threads num] [--journal <file-path>] [--skip-existing] \\\n"
+            "\t\t[--queue-window num] [--ligand-payload] [--shard-output] \\\n"
+            "\t\t[--write-queue num] [--top num] [--top-models] \\\n"
             "\t\t--vina-ligand-dir <dir-path> [--vina-out-dir <dir-path>] [--vina-log-dir <dir-path>] [--vina-out-suffix <str>] \\\n\t\t vina <vina options>";
     vina_options_t vina_opts;
     boost::program_options::variables_map vm;
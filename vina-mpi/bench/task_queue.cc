@@ -0,0 +1,106 @@
+//============================================================================
+// Name        : task_queue.cc
+// Author      : Fabian Mora
+// Version     : 1.0
+// License     : MIT license
+// Description : Compares task_queue and dense_task_queue on ZINC like ligand paths: push throughput,
+//               pop and completed throughput draining the queue in batches, as the master does, and
+//               the resident memory of the filled queue. Every run is forked, so that the memory of
+//               one does not count in the next.
+//
+//               usage: vina-mpi-bench-task-queue [tasks ...] (default: 10000000 100000000)
+//============================================================================
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "master/task_queue.hh"
+#include "master/dense_task_queue.hh"
+
+namespace {
+constexpr size_t batch = 8;
+
+size_t resident_bytes() {
+    std::ifstream statm("/proc/self/statm");
+    size_t pages = 0;
+    size_t resident = 0;
+    statm >> pages >> resident;
+    return resident * static_cast <size_t>(sysconf(_SC_PAGESIZE));
+}
+
+std::string ligand(size_t i) {
+    char path[64];
+    std::snprintf(path, sizeof(path), "zinc/%c%c/%c%c%c%c/ZINC%012zu.pdbqt", 'A' + int(i % 11),
+            'A' + int(i / 11 % 13), 'A' + int(i % 5), 'A' + int(i % 7), 'A' + int(i % 3), 'A' + int(i % 2), i);
+    return path;
+}
+
+double seconds_since(const std::chrono::steady_clock::time_point &start) {
+    return std::chrono::duration <double>(std::chrono::steady_clock::now() - start).count();
+}
+
+template <typename Queue>
+void run(const char *name, size_t tasks) {
+    size_t base = resident_bytes();
+    Queue queue;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < tasks; ++i)
+        queue.push(ligand(i));
+    double push_time = seconds_since(start);
+    size_t filled = resident_bytes() - base;
+    double pop_time = 0;
+    double completed_time = 0;
+    size_t checksum = 0;
+    std::vector <std::pair <std::string*, int64_t>> popped;
+    while (!queue.empty()) {
+        start = std::chrono::steady_clock::now();
+        popped = queue.pop(batch);
+        pop_time += seconds_since(start);
+        checksum += popped.front().first->size();
+        start = std::chrono::steady_clock::now();
+        for (auto &task : popped)
+            queue.completed(task.second);
+        completed_time += seconds_since(start);
+    }
+    std::cout << std::setw(18) << name << std::setw(12) << tasks << std::fixed << std::setprecision(2)
+            << std::setw(14) << tasks / push_time / 1e6 << std::setw(13) << tasks / pop_time / 1e6
+            << std::setw(19) << tasks / completed_time / 1e6 << std::setw(14) << filled / double(1 << 20)
+            << std::setw(13) << double(filled) / tasks << "   (" << checksum % 1000 << ")" << std::endl;
+}
+
+template <typename Queue>
+void fork_run(const char *name, size_t tasks) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        run <Queue>(name, tasks);
+        std::exit(0);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        std::cout << std::setw(18) << name << std::setw(12) << tasks << "   failed (out of memory?)" << std::endl;
+}
+}
+
+int main(int argc, char *argv[]) {
+    using namespace MPIBatch;
+    std::vector <size_t> sizes;
+    for (int i = 1; i < argc; ++i)
+        sizes.push_back(std::strtoull(argv[i], nullptr, 10));
+    if (sizes.empty())
+        sizes = { 10000000, 100000000 };
+    std::cout << "             queue       tasks  push (M/s)  pop (M/s)  completed (M/s)  memory (MiB)  bytes/task"
+            << std::endl;
+    for (size_t tasks : sizes) {
+        fork_run <task_queue <std::string>>("task_queue", tasks);
+        fork_run <dense_task_queue <std::string>>("dense_task_queue", tasks);
+    }
+    return 0;
+}
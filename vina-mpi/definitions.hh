@@ -10,6 +10,7 @@
 #define __DEFINITIONS_HH__
 
 #include <chrono>
+#include <climits>
 #include <type_traits>
 #include <mpi.h>
 
@@ -56,7 +57,8 @@ enum class MessageTags : int {
     m2w_status = w2m_status,
     send_data,
     recv_data = send_data,
-    kill
+    kill,
+    results
 };
 
 enum class LogType {
@@ -80,15 +82,26 @@ enum class ServerMode {
 constexpr std::chrono::milliseconds small_sleep(10);
 constexpr std::chrono::milliseconds medium_sleep(50);
 constexpr std::chrono::milliseconds large_sleep(100);
+constexpr std::chrono::microseconds min_idle_sleep(20);
+constexpr std::chrono::milliseconds max_idle_sleep(2);
 constexpr std::chrono::milliseconds small_cycle_timeout(100);
 constexpr std::chrono::milliseconds cycle_timeout(500);
-constexpr std::chrono::seconds task_status_cycle(5);
+constexpr std::chrono::seconds worker_ping_interval(1);
 constexpr std::chrono::seconds ping_timeout(5);
 constexpr std::chrono::seconds send_recv_timeout(3);
 constexpr std::chrono::seconds worker_timeout(10);
 constexpr std::chrono::seconds master_timeout(20);
+constexpr std::chrono::seconds batch_target_duration(30);
+constexpr std::chrono::seconds journal_sync_interval(5);
+
+constexpr size_t worker_prefetch = 1; // batches a worker holds besides the one it runs
+constexpr size_t journal_sync_records = 64; // journal records buffered before an fsync
+constexpr size_t shard_flush_size = 4 << 20; // bytes of output models buffered before a write to the shard
+constexpr size_t prefetch_batch = 256; // ligands the master reads ahead at once with --ligand-payload
+constexpr size_t prefetch_capacity = 64 << 20; // bytes of ligands the master holds read ahead
 
 constexpr int64_t invalid_task_id = -1;
+constexpr int no_bound = INT_MAX; // the bound of a status reply when the master sets none
 
 template <bool condidition>
 using enable_it = std::enable_if_t<condidition, int>;
@@ -0,0 +1,124 @@
+//============================================================================
+// Name        : async_writer.cc
+// Author      : Fabian Mora
+// Version     : 1.0
+// License     : MIT license
+// Description :
+//============================================================================
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <unistd.h>
+#include "async_writer.hh"
+
+namespace MPIBatch {
+AsyncWriter::~AsyncWriter() {
+    stop();
+}
+
+void AsyncWriter::loop() {
+    std::unique_lock <std::mutex> lock(__mutex__);
+    while (true) {
+        __pushed__.wait(lock, [this]() {
+            return __stop__ || !__queue__.empty();
+        });
+        if (__queue__.empty())
+            break;
+        buffer_t buffer = std::move(__queue__.front());
+        __queue__.pop_front();
+        __writing__ = true;
+        lock.unlock();
+        try {
+            buffer.sink(buffer.data);
+        } catch (std::exception &exc) {
+            std::cerr << exc.what() << std::endl;
+        }
+        lock.lock();
+        __writing__ = false;
+        __queued_bytes__ -= buffer.data.size();
+        __popped__.notify_all();
+    }
+}
+
+void AsyncWriter::start(size_t capacity) {
+    stop();
+    std::lock_guard <std::mutex> lock(__mutex__);
+    __capacity__ = std::max(capacity, size_t(1));
+    __stop__ = false;
+    __thread__ = std::thread(&AsyncWriter::loop, this);
+}
+
+void AsyncWriter::stop() {
+    if (!__thread__.joinable())
+        return;
+    {
+        std::lock_guard <std::mutex> lock(__mutex__);
+        __stop__ = true;
+    }
+    __pushed__.notify_all();
+    __thread__.join();
+}
+
+bool AsyncWriter::started() const {
+    return __thread__.joinable();
+}
+
+void AsyncWriter::push(std::string &&data, const sink_t &sink) {
+    if (!started()) {
+        sink(data);
+        return;
+    }
+    std::unique_lock <std::mutex> lock(__mutex__);
+    // A buffer larger than the queue waits until the queue is empty
+    __popped__.wait(lock, [this, &data]() {
+        return __queued_bytes__ == 0 || __queued_bytes__ + data.size() <= __capacity__;
+    });
+    __queued_bytes__ += data.size();
+    __queue__.push_back(buffer_t { std::move(data), sink });
+    lock.unlock();
+    __pushed__.notify_one();
+}
+
+void AsyncWriter::write_file(const std::string &path, std::string &&data) {
+    push(std::move(data), [path](const std::string &contents) {
+        std::ofstream file(path, std::ios::out | std::ios::binary | std::ios::trunc);
+        file.write(contents.data(), contents.size());
+        if (!file)
+            throw(std::runtime_error("Couldn't write " + path));
+    });
+}
+
+void AsyncWriter::append(int fd, std::string &&data) {
+    push(std::move(data), [fd](const std::string &contents) {
+        write_fd(fd, contents);
+    });
+}
+
+void AsyncWriter::drain() {
+    if (!started())
+        return;
+    std::unique_lock <std::mutex> lock(__mutex__);
+    __popped__.wait(lock, [this]() {
+        return __queue__.empty() && !__writing__;
+    });
+}
+
+void AsyncWriter::write_fd(int fd, const std::string &data) {
+    const char *ptr = data.data();
+    size_t size = data.size();
+    while (size > 0) {
+        ssize_t written = ::write(fd, ptr, size);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            throw(std::runtime_error(std::string("Couldn't write the output: ") + std::strerror(errno)));
+        }
+        ptr += written;
+        size -= static_cast <size_t>(written);
+    }
+}
+}
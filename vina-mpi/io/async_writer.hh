@@ -0,0 +1,65 @@
+//============================================================================
+// Name        : async_writer.hh
+// Author      : Fabian Mora
+// Version     : 1.0
+// License     : MIT license
+// Description :
+//============================================================================
+
+#ifndef __ASYNC_WRITER_HH__
+#define __ASYNC_WRITER_HH__
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "../definitions.hh"
+
+namespace MPIBatch {
+// Writes the output of a process from one background thread: the callers hand over formatted buffers
+// and return, the buffers are written in the order they were handed over. The queue holds up to capacity
+// bytes, a caller blocks while it is full. Without start the buffers are written by the caller.
+class AsyncWriter {
+public:
+    using sink_t = std::function <void(const std::string&)>;
+private:
+    struct buffer_t {
+        std::string data;
+        sink_t sink;
+    };
+    std::deque <buffer_t> __queue__;
+    size_t __queued_bytes__ = 0;
+    size_t __capacity__ = 0;
+    bool __writing__ = false;
+    bool __stop__ = false;
+    std::mutex __mutex__;
+    std::condition_variable __pushed__;
+    std::condition_variable __popped__;
+    std::thread __thread__;
+
+    void loop();
+public:
+    AsyncWriter() = default;
+    ~AsyncWriter();
+    AsyncWriter(const AsyncWriter&) = delete;
+    AsyncWriter& operator=(const AsyncWriter&) = delete;
+
+    void start(size_t capacity);
+    void stop(); // writes the queued buffers and joins the thread
+    bool started() const;
+
+    // Passes data to sink on the writer thread
+    void push(std::string &&data, const sink_t &sink);
+    // Creates or truncates path with data
+    void write_file(const std::string &path, std::string &&data);
+    // Appends data to fd, which has to stay open until drain returns
+    void append(int fd, std::string &&data);
+    void drain(); // waits until the queued buffers are written
+
+    static void write_fd(int fd, const std::string &data);
+};
+}
+#endif
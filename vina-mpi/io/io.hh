@@ -36,14 +36,13 @@ std::ostream& print(const std::tuple <T0, T...> &tuple, std::ostream &ost, std::
 template <size_t i, typename T0, typename ...T, std::enable_if_t <(i >= sizeof...(T)), int> = 0>
 std::ostream& print(const std::tuple <T0, T...> &tuple, std::ostream &ost, std::string separator);
 
-template <size_t i = 0, typename T0 = void, typename ...T,
-        std::enable_if_t <(i < sizeof...(T)), int> = 0>
+template <size_t i, typename T0, typename ...T, std::enable_if_t <(i < sizeof...(T)), int>>
 std::ostream& print(const std::tuple <T0, T...> &tuple, std::ostream &ost, std::string separator) {
     ost << std::get <i>(tuple) << separator;
     return print <i + 1>(tuple, ost, separator);
 }
 
-template <size_t i, typename T0, typename ...T, std::enable_if_t <(i >= sizeof...(T)), int> = 0>
+template <size_t i, typename T0, typename ...T, std::enable_if_t <(i >= sizeof...(T)), int>>
 std::ostream& print(const std::tuple <T0, T...> &tuple, std::ostream &ost, std::string separator) {
     ost << std::get <i>(tuple);
     return ost;
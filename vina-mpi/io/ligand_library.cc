@@ -0,0 +1,245 @@
+//============================================================================
+// Name        : ligand_library.cc
+// Author      : Fabian Mora
+// Version     : 1.0
+// License     : MIT license
+// Description :
+//============================================================================
+
+#include <filesystem>
+#include <sstream>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include "ligand_library.hh"
+
+namespace MPIBatch {
+namespace {
+constexpr size_t library_buffer_size = 1 << 20; // sequential reads of the library and its index
+constexpr char ref_separator = '\t';
+constexpr uint64_t read_gap = 4096; // bytes between two molecules read together, their MODEL and ENDMDL records
+
+uint64_t pread_all(int fd, char *data, uint64_t length, uint64_t offset) {
+    uint64_t done = 0;
+    while (done < length) {
+        ssize_t count = ::pread(fd, data + done, length - done, static_cast <off_t>(offset + done));
+        if (count <= 0)
+            break;
+        done += static_cast <uint64_t>(count);
+    }
+    return done;
+}
+
+bool starts_with(const std::string &str, const char *prefix) {
+    return str.compare(0, std::char_traits <char>::length(prefix), prefix) == 0;
+}
+
+// The rest of the record, trimmed; the characters that can't be in a file name or a tab separated
+// field are replaced
+std::string molecule_name(const std::string &value) {
+    size_t begin = value.find_first_not_of(" \t\r");
+    if (begin == std::string::npos)
+        return std::string();
+    std::string name = value.substr(begin, value.find_last_not_of(" \t\r") - begin + 1);
+    for (char &c : name)
+        if (c == '/' || static_cast <unsigned char>(c) < ' ')
+            c = '_';
+    return name;
+}
+}
+
+ligand_ref_t ligand_ref_t::parse(const std::string &task) {
+    ligand_ref_t ref;
+    size_t first = task.find(ref_separator);
+    if (first == std::string::npos) {
+        ref.path = task;
+        return ref;
+    }
+    ref.path = task.substr(0, first);
+    std::istringstream fields(task.substr(first + 1));
+    fields >> ref.offset >> ref.length;
+    fields.get();
+    std::getline(fields, ref.name);
+    return ref;
+}
+
+std::string ligand_ref_t::str() const {
+    if (!sliceQ())
+        return path;
+    return path + ref_separator + std::to_string(offset) + ref_separator + std::to_string(length)
+            + ref_separator + name;
+}
+
+bool ligand_ref_t::sliceQ() const {
+    return length > 0;
+}
+
+std::string ligand_name(const std::string &task) {
+    ligand_ref_t ref = ligand_ref_t::parse(task);
+    if (ref.sliceQ())
+        return ref.name;
+    return std::filesystem::path(ref.path).stem().string();
+}
+
+bool read_ligand(const std::string &task, std::string &contents) {
+    ligand_ref_t ref = ligand_ref_t::parse(task);
+    int fd = ::open(ref.path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    uint64_t length = ref.length;
+    if (!ref.sliceQ()) {
+        off_t size = ::lseek(fd, 0, SEEK_END);
+        length = (size > 0) ? static_cast <uint64_t>(size) : 0;
+    }
+    contents.resize(length);
+    uint64_t done = pread_all(fd, contents.data(), length, ref.offset);
+    ::close(fd);
+    contents.resize(done);
+    return done == length && length > 0;
+}
+
+std::vector <bool> read_ligands(const std::vector <std::string> &tasks, std::vector <std::string> &contents) {
+    std::vector <bool> read(tasks.size(), false);
+    contents.assign(tasks.size(), std::string());
+    std::vector <ligand_ref_t> refs;
+    for (const std::string &task : tasks)
+        refs.push_back(ligand_ref_t::parse(task));
+    std::string span;
+    size_t i = 0;
+    while (i < tasks.size()) {
+        if (!refs[i].sliceQ()) {
+            read[i] = read_ligand(tasks[i], contents[i]);
+            ++i;
+            continue;
+        }
+        // The molecules [i, j) of the same library, in order and close together
+        size_t j = i + 1;
+        uint64_t begin = refs[i].offset;
+        uint64_t end = begin + refs[i].length;
+        while (j < tasks.size() && refs[j].sliceQ() && refs[j].path == refs[i].path && refs[j].offset >= end
+                && refs[j].offset - end <= read_gap && refs[j].offset + refs[j].length - begin <= library_buffer_size) {
+            end = refs[j].offset + refs[j].length;
+            ++j;
+        }
+        int fd = ::open(refs[i].path.c_str(), O_RDONLY);
+        if (fd >= 0) {
+            span.resize(end - begin);
+            span.resize(pread_all(fd, span.data(), end - begin, begin));
+            ::close(fd);
+            for (size_t k = i; k < j; ++k) {
+                if (refs[k].offset + refs[k].length - begin > span.size())
+                    break;
+                contents[k] = span.substr(refs[k].offset - begin, refs[k].length);
+                read[k] = true;
+            }
+        }
+        i = j;
+    }
+    return read;
+}
+
+bool ligand_libraryQ(const std::string &path) {
+    std::ifstream file(path);
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.find_first_not_of(" \t\r") == std::string::npos || starts_with(line, "REMARK"))
+            continue;
+        return starts_with(line, "MODEL");
+    }
+    return false;
+}
+
+LigandLibrary::LigandLibrary(const std::string &path) :
+        __path__(path), __stem__(std::filesystem::path(path).stem().string()) {
+    namespace fs = std::filesystem;
+    std::string index_path = path + ".idx";
+    std::error_code error;
+    bool fresh = fs::exists(index_path, error)
+            && fs::last_write_time(index_path, error) >= fs::last_write_time(path, error) && !error;
+    if (fresh || build_index(index_path)) {
+        __index__.open(index_path);
+        if (__index__.is_open())
+            return;
+    }
+    __library__.open(path, std::ios::binary);
+}
+
+// The next MODEL block, its byte range excludes the MODEL and ENDMDL records, which vina won't parse
+bool LigandLibrary::scan(std::istream &library, ligand_ref_t &ref) {
+    std::string line;
+    bool modelQ = false;
+    while (std::getline(library, line)) {
+        uint64_t begin = __offset__;
+        __offset__ += line.size() + (library.eof() ? 0 : 1);
+        if (starts_with(line, "MODEL")) {
+            modelQ = true;
+            ref = ligand_ref_t();
+            ref.path = __path__;
+            ref.offset = __offset__;
+            ++__models__;
+        } else if (modelQ && starts_with(line, "REMARK") && line.find("Name =") != std::string::npos) {
+            ref.name = molecule_name(line.substr(line.find("Name =") + 6));
+        } else if (modelQ && starts_with(line, "ENDMDL")) {
+            ref.length = begin - ref.offset;
+            if (ref.length == 0) {
+                modelQ = false;
+                continue;
+            }
+            if (ref.name.empty())
+                ref.name = __stem__ + "_" + std::to_string(__models__);
+            // Protomers and tautomers often share a name, they would share their outputs
+            if (!__names__.insert(ref.name).second) {
+                ref.name += "_" + std::to_string(__models__);
+                __names__.insert(ref.name);
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+// Written aside and renamed, so that an interrupted build doesn't leave a truncated index
+bool LigandLibrary::build_index(const std::string &index_path) {
+    std::vector <char> buffer(library_buffer_size);
+    std::ifstream library;
+    library.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+    library.open(__path__, std::ios::binary);
+    std::string tmp_path = index_path + ".tmp";
+    std::ofstream index(tmp_path);
+    if (!library.is_open() || !index.is_open())
+        return false;
+    ligand_ref_t ref;
+    while (scan(library, ref))
+        index << ref.offset << ' ' << ref.length << ' ' << ref.name << '\n';
+    index.close();
+    __offset__ = 0;
+    __models__ = 0;
+    __names__.clear();
+    std::error_code error;
+    if (index.fail()) {
+        std::filesystem::remove(tmp_path, error);
+        return false;
+    }
+    std::filesystem::rename(tmp_path, index_path, error);
+    return !error;
+}
+
+bool LigandLibrary::next(std::string &task) {
+    ligand_ref_t ref;
+    if (__index__.is_open()) {
+        std::string line;
+        if (!std::getline(__index__, line))
+            return false;
+        std::istringstream fields(line);
+        ref.path = __path__;
+        fields >> ref.offset >> ref.length;
+        fields.get();
+        std::getline(fields, ref.name);
+        if (!fields)
+            return false;
+    } else if (!__library__.is_open() || !scan(__library__, ref))
+        return false;
+    task = ref.str();
+    return true;
+}
+}
@@ -0,0 +1,66 @@
+//============================================================================
+// Name        : ligand_library.hh
+// Author      : Fabian Mora
+// Version     : 1.0
+// License     : MIT license
+// Description :
+//============================================================================
+
+#ifndef __IO_LIGAND_LIBRARY_HH__
+#define __IO_LIGAND_LIBRARY_HH__
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+namespace MPIBatch {
+// A task names a ligand file, or a molecule of a multi-molecule PDBQT library (MODEL/ENDMDL blocks):
+// "<library>\t<offset>\t<length>\t<name>", the byte range of the block between its MODEL and ENDMDL
+// records
+struct ligand_ref_t {
+    std::string path;
+    uint64_t offset = 0;
+    uint64_t length = 0; // 0 for a whole file
+    std::string name;
+
+    static ligand_ref_t parse(const std::string &task);
+    std::string str() const;
+    bool sliceQ() const;
+};
+
+// The name of the outputs of a task: the molecule name, or the file stem
+std::string ligand_name(const std::string &task);
+// The PDBQT of a task, a molecule of a library is read with a single pread
+bool read_ligand(const std::string &task, std::string &contents);
+// The PDBQT of every task, whether it was read; the molecules of a library that follow one another are
+// read together, with one pread of up to 1 MiB
+std::vector <bool> read_ligands(const std::vector <std::string> &tasks, std::vector <std::string> &contents);
+// Whether the first record of a PDBQT file is a MODEL
+bool ligand_libraryQ(const std::string &path);
+
+// Enumerates the molecules of a library from its index, "<library>.idx", with a line "<offset> <length>
+// <name>" per molecule. The index is built by the first run, with one sequential pass over the library,
+// and rebuilt when the library is newer; when it can't be written the library is scanned instead.
+// A molecule is named after its "REMARK  Name =" record, or the library and its position; a name
+// already taken gets the position appended.
+class LigandLibrary {
+private:
+    std::string __path__;
+    std::string __stem__;
+    std::ifstream __index__;
+    std::ifstream __library__;
+    uint64_t __offset__ = 0;
+    size_t __models__ = 0;
+    std::unordered_set <std::string> __names__;
+
+    bool scan(std::istream &library, ligand_ref_t &ref);
+    bool build_index(const std::string &index_path);
+public:
+    explicit LigandLibrary(const std::string &path);
+    // Sets the next molecule, returns false once there are no more
+    bool next(std::string &task);
+};
+}
+#endif
@@ -0,0 +1,112 @@
+//============================================================================
+// Name        : ligand_prefetcher.cc
+// Author      : Fabian Mora
+// Version     : 1.0
+// License     : MIT license
+// Description :
+//============================================================================
+
+#include <algorithm>
+#include <vector>
+#include "ligand_prefetcher.hh"
+#include "ligand_library.hh"
+
+namespace MPIBatch {
+LigandPrefetcher::~LigandPrefetcher() {
+    stop();
+}
+
+void LigandPrefetcher::loop() {
+    std::unique_lock <std::mutex> lock(__mutex__);
+    std::vector <std::string> batch;
+    std::vector <std::string> contents;
+    while (true) {
+        __pushed__.wait(lock, [this]() {
+            return __stop__ || (!__pending__.empty() && __bytes__ < __capacity__);
+        });
+        if (__stop__)
+            break;
+        batch.clear();
+        while (!__pending__.empty() && batch.size() < prefetch_batch) {
+            // Skips the ligands taken in the meantime
+            if (__entries__.count(__pending__.front()) > 0)
+                batch.push_back(std::move(__pending__.front()));
+            __pending__.pop_front();
+        }
+        lock.unlock();
+        std::vector <bool> read = read_ligands(batch, contents);
+        lock.lock();
+        for (size_t i = 0; i < batch.size(); ++i) {
+            auto it = __entries__.find(batch[i]);
+            if (it == __entries__.end())
+                continue;
+            if (!read[i]) { // left to the caller
+                __entries__.erase(it);
+                continue;
+            }
+            it->second.read = true;
+            __bytes__ += contents[i].size();
+            it->second.contents = std::move(contents[i]);
+        }
+    }
+}
+
+void LigandPrefetcher::start(size_t capacity) {
+    stop();
+    std::lock_guard <std::mutex> lock(__mutex__);
+    __capacity__ = std::max(capacity, size_t(1));
+    __stop__ = false;
+    __thread__ = std::thread(&LigandPrefetcher::loop, this);
+}
+
+void LigandPrefetcher::stop() {
+    if (!__thread__.joinable())
+        return;
+    {
+        std::lock_guard <std::mutex> lock(__mutex__);
+        __stop__ = true;
+    }
+    __pushed__.notify_all();
+    __thread__.join();
+    __pending__.clear();
+    __entries__.clear();
+    __bytes__ = 0;
+}
+
+bool LigandPrefetcher::started() const {
+    return __thread__.joinable();
+}
+
+void LigandPrefetcher::push(const std::string &ligand) {
+    if (!started())
+        return;
+    {
+        std::lock_guard <std::mutex> lock(__mutex__);
+        if (!__entries__.emplace(ligand, entry_t()).second)
+            return;
+        __pending__.push_back(ligand);
+    }
+    __pushed__.notify_one();
+}
+
+bool LigandPrefetcher::take(const std::string &ligand, std::string &contents) {
+    if (!started())
+        return false;
+    bool read = false;
+    {
+        std::lock_guard <std::mutex> lock(__mutex__);
+        auto it = __entries__.find(ligand);
+        if (it == __entries__.end())
+            return false;
+        read = it->second.read;
+        if (read) {
+            __bytes__ -= it->second.contents.size();
+            contents = std::move(it->second.contents);
+        }
+        __entries__.erase(it);
+    }
+    if (read)
+        __pushed__.notify_one();
+    return read;
+}
+}
@@ -0,0 +1,58 @@
+//============================================================================
+// Name        : ligand_prefetcher.hh
+// Author      : Fabian Mora
+// Version     : 1.0
+// License     : MIT license
+// Description :
+//============================================================================
+
+#ifndef __LIGAND_PREFETCHER_HH__
+#define __LIGAND_PREFETCHER_HH__
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#include "../definitions.hh"
+
+namespace MPIBatch {
+// Reads the ligands ahead of their dispatch from one background thread, so that the master doesn't wait
+// on the file system while it answers the workers. The ligands are pushed as they enter the queue and
+// read in that order, in batches of up to prefetch_batch with read_ligands; take hands over the
+// contents. Up to capacity bytes are held, the reads pause while they are. A ligand taken before it was
+// read is dropped from the reads, the caller reads it itself. Without start nothing is read.
+class LigandPrefetcher {
+private:
+    struct entry_t {
+        bool read = false;
+        std::string contents;
+    };
+    std::deque <std::string> __pending__;
+    std::unordered_map <std::string, entry_t> __entries__; // pushed and not taken yet
+    size_t __bytes__ = 0;
+    size_t __capacity__ = 0;
+    bool __stop__ = false;
+    std::mutex __mutex__;
+    std::condition_variable __pushed__; // a ligand was pushed or taken
+    std::thread __thread__;
+
+    void loop();
+public:
+    LigandPrefetcher() = default;
+    ~LigandPrefetcher();
+    LigandPrefetcher(const LigandPrefetcher&) = delete;
+    LigandPrefetcher& operator=(const LigandPrefetcher&) = delete;
+
+    void start(size_t capacity);
+    void stop(); // drops what wasn't taken and joins the thread
+    bool started() const;
+
+    void push(const std::string &ligand);
+    // Moves the contents of the ligand into contents, false if it wasn't read
+    bool take(const std::string &ligand, std::string &contents);
+};
+}
+#endif
@@ -17,6 +17,7 @@ void Logger::clear() {
     __filepath__.clear();
     close();
     __std_out__ = false;
+    __writer__ = nullptr;
 }
 
 void Logger::create_directory() {
@@ -30,8 +31,9 @@ void Logger::create_directory() {
 std::string Logger::date() {
     char buffer[80];
     std::time_t end_time = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
-    auto ti = std::localtime(&end_time);
-    std::strftime(buffer, 80, "%T %d-%m-%Y %Z", ti);
+    std::tm ti;
+    localtime_r(&end_time, &ti);
+    std::strftime(buffer, 80, "%T %d-%m-%Y %Z", &ti);
     return std::string(buffer);
 }
 
@@ -53,6 +55,7 @@ Logger::Logger(Logger &&other) :
     __std_out__ = other.__std_out__;
     __filepath__ = other.__filepath__;
     __file_openQ__ = other.__file_openQ__;
+    __writer__ = other.__writer__;
     other.clear();
 }
 
@@ -61,6 +64,7 @@ Logger& Logger::operator=(Logger &&other) {
     __std_out__ = other.__std_out__;
     __filepath__ = other.__filepath__;
     __file_openQ__ = other.__file_openQ__;
+    __writer__ = other.__writer__;
     other.clear();
     return *this;
 }
@@ -86,6 +90,8 @@ void Logger::open(std::string file_path, std::ios_base::openmode openMode) {
 
 void Logger::close() {
     if (__file_openQ__) {
+        if (__writer__)
+            __writer__->drain();
         try {
             if (file_stream.is_open())
                 __io__::close(file_stream);
@@ -129,4 +135,11 @@ void Logger::set_info(NodeType type, std::string hostname, int rank) {
 void Logger::set_std_out(bool std_out) {
     __std_out__ = std_out;
 }
+
+void Logger::set_writer(AsyncWriter *writer) {
+    std::lock_guard <std::mutex> lock(__write_mutex__);
+    if (__writer__)
+        __writer__->drain();
+    __writer__ = writer;
+}
 }
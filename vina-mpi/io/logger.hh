@@ -11,11 +11,13 @@
 
 #include <filesystem>
 #include <iostream>
+#include <mutex>
 #include <string>
 #include <iomanip>
 
 #include "../definitions.hh"
 #include "io.hh"
+#include "async_writer.hh"
 
 namespace MPIBatch {
 class Logger {
@@ -29,6 +31,8 @@ private:
     std::ostream &stdout_stream;
     std::ostream &stderr_stream;
     bool __file_openQ__ = false;
+    std::mutex __write_mutex__; // the tasks of a worker log from their own threads
+    AsyncWriter *__writer__ = nullptr; // writes the file when set
 
     void clear();
     void create_directory();
@@ -58,6 +62,7 @@ public:
 
     void set_info(NodeType type, std::string hostname, int rank);
     void set_std_out(bool std_out);
+    void set_writer(AsyncWriter *writer);
 
     template <typename ... Args>
     void log(LogType log_type, const Args &... args);
@@ -78,8 +83,15 @@ inline void MPIBatch::Logger::log(LogType log_type, const Args &... args) {
         ost << " ";
         __io__::print(ost, "", args...) << std::endl;
         std::string msg = ost.str();
-        if (__file_openQ__ && file_stream.is_open())
-            file_stream << msg;
+        std::lock_guard <std::mutex> lock(__write_mutex__);
+        if (__file_openQ__ && file_stream.is_open()) {
+            if (__writer__)
+                __writer__->push(std::string(msg), [this](const std::string &buffer) {
+                    file_stream << buffer;
+                });
+            else
+                file_stream << msg;
+        }
         if (__std_out__) {
             if (log_type == LogType::error)
                 stderr_stream << msg;
@@ -0,0 +1,379 @@
+//============================================================================
+// Name        : dense_task_queue.hh
+// Author      : Fabian Mora
+// Version     : 1.0
+// License     : MIT license
+// Description :
+//============================================================================
+
+#ifndef __DENSE_TASK_QUEUE_HH__
+#define __DENSE_TASK_QUEUE_HH__
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "../definitions.hh"
+
+namespace MPIBatch {
+constexpr size_t dense_chunk_tasks = 4096; // a multiple of 64
+
+// Payloads of one chunk of tasks, contiguously
+template <typename data_t>
+class dense_payloads {
+private:
+    std::vector <data_t> __data__;
+public:
+    void push(data_t &&data) {
+        __data__.push_back(std::move(data));
+    }
+    data_t get(size_t index) const {
+        return __data__[index];
+    }
+    void clear() {
+        std::vector <data_t>().swap(__data__);
+    }
+    size_t memory() const {
+        return __data__.capacity() * sizeof(data_t);
+    }
+};
+
+// Strings share one arena, a payload is the range between its offset and the next one
+template <>
+class dense_payloads <std::string> {
+private:
+    std::string __arena__;
+    std::vector <uint64_t> __offsets__ = std::vector <uint64_t>(1, 0);
+public:
+    void push(std::string &&data) {
+        __arena__ += data;
+        __offsets__.push_back(__arena__.size());
+    }
+    std::string get(size_t index) const {
+        return __arena__.substr(__offsets__[index], __offsets__[index + 1] - __offsets__[index]);
+    }
+    void clear() {
+        std::string().swap(__arena__);
+        std::vector <uint64_t>().swap(__offsets__);
+    }
+    size_t memory() const {
+        return __arena__.capacity() + __offsets__.capacity() * sizeof(uint64_t);
+    }
+};
+
+// The payloads, priorities and completion bits of the tasks, by id, in chunks of dense_chunk_tasks
+// ids. A chunk is released once all its tasks completed, so the memory follows the tasks in flight
+// rather than all the tasks ever added.
+template <typename data_t>
+class dense_store {
+private:
+    struct chunk_t {
+        dense_payloads <data_t> payloads;
+        std::vector <double> priorities; // only with a priority
+        std::array <uint64_t, dense_chunk_tasks / 64> completed_bits = { };
+        size_t completed = 0;
+    };
+    std::deque <chunk_t> __chunks__; // the first is chunk __first__, the released ones before it are dropped
+    size_t __first__ = 0;
+    size_t __size__ = 0;
+
+    chunk_t& chunk(size_t id) {
+        return __chunks__[id / dense_chunk_tasks - __first__];
+    }
+    const chunk_t& chunk(size_t id) const {
+        return __chunks__[id / dense_chunk_tasks - __first__];
+    }
+public:
+    size_t push(data_t &&data) {
+        if (__size__ % dense_chunk_tasks == 0)
+            __chunks__.emplace_back();
+        __chunks__.back().payloads.push(std::move(data));
+        return __size__++;
+    }
+    data_t get(size_t id) const {
+        return chunk(id).payloads.get(id % dense_chunk_tasks);
+    }
+    double priority(size_t id) const {
+        return chunk(id).priorities[id % dense_chunk_tasks];
+    }
+    void set_priority(size_t id, double priority) {
+        chunk_t &c = chunk(id);
+        if (c.priorities.empty())
+            c.priorities.resize(dense_chunk_tasks);
+        c.priorities[id % dense_chunk_tasks] = priority;
+    }
+    void complete(size_t id) {
+        chunk_t &c = chunk(id);
+        size_t index = id % dense_chunk_tasks;
+        c.completed_bits[index / 64] |= uint64_t(1) << (index % 64);
+        if (++c.completed < dense_chunk_tasks)
+            return;
+        c.payloads.clear();
+        std::vector <double>().swap(c.priorities);
+        while (!__chunks__.empty() && __chunks__.front().completed == dense_chunk_tasks) {
+            __chunks__.pop_front();
+            ++__first__;
+        }
+    }
+    bool completedQ(size_t id) const {
+        if (id >= __size__)
+            return false;
+        if (id / dense_chunk_tasks < __first__)
+            return true;
+        size_t index = id % dense_chunk_tasks;
+        return (chunk(id).completed_bits[index / 64] >> (index % 64)) & 1;
+    }
+    size_t size() const {
+        return __size__;
+    }
+    size_t memory() const {
+        size_t bytes = 0;
+        for (const chunk_t &c : __chunks__)
+            bytes += sizeof(chunk_t) + c.payloads.memory() + c.priorities.capacity() * sizeof(double);
+        return bytes;
+    }
+};
+
+// A drop-in replacement for task_queue for tens of millions of tasks: the tasks are stored by id in
+// chunks (strings in one arena per chunk), the pending ids are a vector of 32 bit ids. Only the
+// scheduled tasks get their payload materialized, which is what pop points to, so a string task costs
+// its characters plus about 12 bytes instead of over 100 for the node based containers of task_queue,
+// and the chunks are released as their tasks complete. Ids are limited to 2^32.
+template <typename data_t>
+class dense_task_queue {
+public:
+    using task_t = data_t;
+    using task_info_t = std::pair <data_t*, int64_t>;
+    using priority_t = std::function <double(const data_t&)>;
+    using source_t = std::function <bool(data_t&)>; // sets the next task, false once there are no more
+private:
+    dense_store <data_t> __store__;
+    std::vector <uint32_t> __queue__; // the pending tasks are __queue__[__head__, end)
+    size_t __head__ = 0;
+    priority_t __priority__;
+    size_t __completed_count__ = 0;
+    std::unordered_map <uint32_t, data_t> __scheduled__;
+    source_t __source__;
+    size_t __window__ = 0;
+
+    size_t pending() const;
+    uint32_t add(data_t &&data);
+    void compact();
+    void sort();
+    void enqueue(uint32_t task_id);
+    void fill();
+public:
+    dense_task_queue() = default;
+
+    bool available_tasks() const;
+    void completed(int64_t task_id);
+    bool completedQ(int64_t task_id) const;
+    bool empty() const;
+    bool finished() const;
+
+    template <typename Iterator>
+    void insert(const Iterator &begin, const Iterator &end);
+    void push(data_t &&data);
+    std::pair <data_t*, int64_t> pop();
+    std::vector <std::pair <data_t*, int64_t>> pop(size_t count);
+    void requeue(std::pair <data_t*, int64_t> &task);
+    std::tuple <size_t, size_t, size_t> status() const;
+
+    void set_priority(const priority_t &priority); // the queued tasks are then handed out highest priority first
+    void reprioritize(); // recomputes the priority of the queued tasks and reorders them
+    // Takes the tasks from source as the queue drains, keeping up to window of them queued
+    void set_source(const source_t &source, size_t window);
+
+    size_t memory() const; // bytes held by the queue, besides the scheduled payloads
+};
+
+template <typename data_t>
+inline size_t dense_task_queue <data_t>::pending() const {
+    return __queue__.size() - __head__;
+}
+
+template <typename data_t>
+inline uint32_t dense_task_queue <data_t>::add(data_t &&data) {
+    if (__store__.size() >= UINT32_MAX)
+        throw(std::length_error("dense_task_queue holds up to 2^32 - 1 tasks"));
+    double priority = __priority__ ? __priority__(data) : 0;
+    size_t task_id = __store__.push(std::move(data));
+    if (__priority__)
+        __store__.set_priority(task_id, priority);
+    return static_cast <uint32_t>(task_id);
+}
+
+// Drops the ids already handed out once they are half of the vector
+template <typename data_t>
+inline void dense_task_queue <data_t>::compact() {
+    if (__head__ < 1024 || __head__ < __queue__.size() / 2)
+        return;
+    __queue__.erase(__queue__.begin(), __queue__.begin() + __head__);
+    __head__ = 0;
+}
+
+// Stable, so that equal priorities keep their FIFO order
+template <typename data_t>
+inline void dense_task_queue <data_t>::sort() {
+    if (!__priority__)
+        return;
+    std::stable_sort(__queue__.begin() + __head__, __queue__.end(), [this](uint32_t x, uint32_t y) {
+        return __store__.priority(x) > __store__.priority(y);
+    });
+}
+
+// Behind the tasks of the same or higher priority
+template <typename data_t>
+inline void dense_task_queue <data_t>::enqueue(uint32_t task_id) {
+    if (!__priority__) {
+        __queue__.push_back(task_id);
+        return;
+    }
+    double priority = __store__.priority(task_id);
+    auto it = std::upper_bound(__queue__.begin() + __head__, __queue__.end(), priority,
+            [this](double p, uint32_t y) {
+                return p > __store__.priority(y);
+            });
+    __queue__.insert(it, task_id);
+}
+
+// Refills the queue once it is down to half the window, so that a priority sorts the new tasks in bulk
+template <typename data_t>
+inline void dense_task_queue <data_t>::fill() {
+    if (!__source__ || pending() > __window__ / 2)
+        return;
+    data_t data;
+    while (pending() < __window__) {
+        if (!__source__(data)) {
+            __source__ = source_t();
+            break;
+        }
+        __queue__.push_back(add(std::move(data)));
+    }
+    sort();
+}
+
+template <typename data_t>
+inline bool dense_task_queue <data_t>::available_tasks() const {
+    return !empty();
+}
+
+template <typename data_t>
+inline void dense_task_queue <data_t>::completed(int64_t task_id) {
+    if (task_id < 0)
+        return;
+    auto it = __scheduled__.find(static_cast <uint32_t>(task_id));
+    if (it != __scheduled__.end()) {
+        __scheduled__.erase(it);
+        __store__.complete(static_cast <size_t>(task_id));
+        ++__completed_count__;
+    }
+}
+
+template <typename data_t>
+inline bool dense_task_queue <data_t>::completedQ(int64_t task_id) const {
+    if (task_id < 0)
+        return false;
+    return __store__.completedQ(static_cast <size_t>(task_id));
+}
+
+template <typename data_t>
+inline bool dense_task_queue <data_t>::empty() const {
+    return pending() == 0;
+}
+
+template <typename data_t>
+inline bool dense_task_queue <data_t>::finished() const {
+    return empty() && __scheduled__.empty();
+}
+
+template <typename data_t>
+template <typename Iterator>
+inline void dense_task_queue <data_t>::insert(const Iterator &begin, const Iterator &end) {
+    for (auto it = begin; it != end; ++it)
+        __queue__.push_back(add(data_t(*it)));
+    sort();
+}
+
+template <typename data_t>
+inline void dense_task_queue <data_t>::push(data_t &&data) {
+    enqueue(add(std::move(data)));
+}
+
+template <typename data_t>
+inline std::pair <data_t*, int64_t> dense_task_queue <data_t>::pop() {
+    std::pair <data_t*, int64_t> result(nullptr, invalid_task_id);
+    if (!empty()) {
+        uint32_t task_id = __queue__[__head__++];
+        result.second = task_id;
+        result.first = &(__scheduled__[task_id] = __store__.get(task_id));
+        compact();
+        fill();
+    }
+    return result;
+}
+
+template <typename data_t>
+inline std::vector <std::pair <data_t*, int64_t>> dense_task_queue <data_t>::pop(size_t count) {
+    std::vector <std::pair <data_t*, int64_t>> result;
+    while (result.size() < count && !empty())
+        result.push_back(pop());
+    return result;
+}
+
+template <typename data_t>
+inline void dense_task_queue <data_t>::requeue(std::pair <data_t*, int64_t> &task) {
+    if (task.second < 0)
+        return;
+    auto it = __scheduled__.find(static_cast <uint32_t>(task.second));
+    if (it == __scheduled__.end())
+        return;
+    __scheduled__.erase(it);
+    uint32_t task_id = static_cast <uint32_t>(task.second);
+    if (__priority__)
+        enqueue(task_id);
+    else if (__head__ > 0)
+        __queue__[--__head__] = task_id;
+    else
+        __queue__.insert(__queue__.begin(), task_id);
+}
+
+template <typename data_t>
+inline std::tuple <size_t, size_t, size_t> dense_task_queue <data_t>::status() const {
+    return std::tuple <size_t, size_t, size_t>(__completed_count__, __scheduled__.size(), pending());
+}
+
+template <typename data_t>
+inline void dense_task_queue <data_t>::set_priority(const priority_t &priority) {
+    __priority__ = priority;
+    reprioritize();
+}
+
+template <typename data_t>
+inline void dense_task_queue <data_t>::reprioritize() {
+    if (!__priority__)
+        return;
+    for (size_t i = __head__; i < __queue__.size(); ++i)
+        __store__.set_priority(__queue__[i], __priority__(__store__.get(__queue__[i])));
+    sort();
+}
+
+template <typename data_t>
+inline void dense_task_queue <data_t>::set_source(const source_t &source, size_t window) {
+    __source__ = source;
+    __window__ = std::max(window, size_t(1));
+    fill();
+}
+
+template <typename data_t>
+inline size_t dense_task_queue <data_t>::memory() const {
+    return __store__.memory() + __queue__.capacity() * sizeof(uint32_t);
+}
+}
+
+#endif
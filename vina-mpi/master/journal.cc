@@ -0,0 +1,126 @@
+//============================================================================
+// Name        : journal.cc
+// Author      : Fabian Mora
+// Version     : 1.0
+// License     : MIT license
+// Description :
+//============================================================================
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <unordered_set>
+#include <fcntl.h>
+#include <unistd.h>
+#include "journal.hh"
+#include "../util/util.hh"
+
+namespace MPIBatch {
+TaskJournal::~TaskJournal() {
+    try {
+        close();
+    } catch (std::exception &exc) {
+        std::cerr << exc.what() << std::endl;
+    }
+}
+
+size_t TaskJournal::read() {
+    __completed__.clear();
+    std::unordered_set <std::string> dispatched;
+    std::ifstream file(__path__, std::ios::binary);
+    std::string line;
+    size_t size = 0;
+    while (std::getline(file, line)) {
+        if (file.eof()) // no newline, the last write was interrupted
+            break;
+        size += line.size() + 1;
+        std::istringstream fields(line);
+        char kind = 0;
+        int64_t task_id = invalid_task_id;
+        fields >> kind >> task_id;
+        if (!fields || fields.get() != ' ')
+            continue;
+        std::string task = line.substr(static_cast <size_t>(fields.tellg()));
+        if (kind == 'D')
+            dispatched.insert(task);
+        else if (kind == 'C')
+            __completed__.insert(task);
+    }
+    __dispatched__ = 0;
+    for (const std::string &task : dispatched)
+        if (__completed__.count(task) == 0)
+            ++__dispatched__;
+    return size;
+}
+
+void TaskJournal::open(const std::string &path) {
+    close();
+    __path__ = path;
+    size_t size = read();
+    __fd__ = ::open(path.c_str(), O_WRONLY | O_APPEND | O_CREAT, 0644);
+    if (__fd__ < 0)
+        throw(std::runtime_error("Couldn't open the journal " + path + ": " + std::strerror(errno)));
+    // Drops a line cut short, the next record would be appended to it
+    if (::ftruncate(__fd__, static_cast <off_t>(size)) != 0)
+        throw(std::runtime_error("Couldn't truncate the journal " + path + ": " + std::strerror(errno)));
+    __last_sync__ = now();
+}
+
+void TaskJournal::close() {
+    if (__fd__ < 0)
+        return;
+    sync(true);
+    ::close(__fd__);
+    __fd__ = -1;
+}
+
+bool TaskJournal::is_open() const {
+    return __fd__ >= 0;
+}
+
+const std::unordered_set <std::string>& TaskJournal::completed() const {
+    return __completed__;
+}
+
+size_t TaskJournal::interrupted() const {
+    return __dispatched__;
+}
+
+void TaskJournal::append(char kind, int64_t task_id, const std::string &task) {
+    if (__fd__ < 0)
+        return;
+    __buffer__ += kind;
+    __buffer__ += ' ';
+    __buffer__ += std::to_string(task_id);
+    __buffer__ += ' ';
+    __buffer__ += task;
+    __buffer__ += '\n';
+    ++__pending__;
+    sync();
+}
+
+void TaskJournal::sync(bool force) {
+    if (__fd__ < 0 || __buffer__.empty())
+        return;
+    if (!force && __pending__ < journal_sync_records && elapsed(now(), __last_sync__) < journal_sync_interval)
+        return;
+    const char *data = __buffer__.data();
+    size_t size = __buffer__.size();
+    while (size > 0) {
+        ssize_t written = ::write(__fd__, data, size);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            throw(std::runtime_error("Couldn't write the journal " + __path__ + ": " + std::strerror(errno)));
+        }
+        data += written;
+        size -= static_cast <size_t>(written);
+    }
+    ::fsync(__fd__);
+    __buffer__.clear();
+    __pending__ = 0;
+    __last_sync__ = now();
+}
+}
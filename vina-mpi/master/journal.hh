@@ -0,0 +1,75 @@
+//============================================================================
+// Name        : journal.hh
+// Author      : Fabian Mora
+// Version     : 1.0
+// License     : MIT license
+// Description :
+//============================================================================
+
+#ifndef __JOURNAL_HH__
+#define __JOURNAL_HH__
+
+#include <sstream>
+#include <string>
+#include <unordered_set>
+
+#include "../definitions.hh"
+
+namespace MPIBatch {
+// Append-only log of the tasks the master dispatched and the ones that completed, one line per task:
+// "D <task id> <task>" or "C <task id> <task>". Task ids are only valid within a run, so a restarted
+// master matches the tasks by their data. The lines are buffered and written with fsync once
+// journal_sync_records accumulate or journal_sync_interval has passed, so a job killed at its wall
+// time loses at most those; a line cut short by the kill is ignored when the journal is read, and
+// dropped before appending.
+class TaskJournal {
+private:
+    int __fd__ = -1;
+    std::string __path__;
+    std::string __buffer__;
+    size_t __pending__ = 0;
+    time_point __last_sync__;
+    std::unordered_set <std::string> __completed__;
+    size_t __dispatched__ = 0;
+
+    size_t read(); // returns the size of the complete lines
+    void append(char kind, int64_t task_id, const std::string &task);
+public:
+    TaskJournal() = default;
+    ~TaskJournal();
+    TaskJournal(const TaskJournal &other) = delete;
+    TaskJournal& operator=(const TaskJournal &other) = delete;
+
+    // Reads the records of the previous runs and opens the file for appending
+    void open(const std::string &path);
+    void close();
+    bool is_open() const;
+
+    // Tasks completed by the previous runs
+    const std::unordered_set <std::string>& completed() const;
+    // Tasks dispatched by the previous runs that never completed
+    size_t interrupted() const;
+
+    template <typename T>
+    void dispatched(int64_t task_id, const T &task);
+    template <typename T>
+    void completed(int64_t task_id, const T &task);
+    // Writes the buffered records if enough of them accumulated or enough time passed, or right away
+    void sync(bool force = false);
+};
+
+template <typename T>
+inline void TaskJournal::dispatched(int64_t task_id, const T &task) {
+    std::ostringstream ost;
+    ost << task;
+    append('D', task_id, ost.str());
+}
+
+template <typename T>
+inline void TaskJournal::completed(int64_t task_id, const T &task) {
+    std::ostringstream ost;
+    ost << task;
+    append('C', task_id, ost.str());
+}
+}
+#endif
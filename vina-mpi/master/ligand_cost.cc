@@ -0,0 +1,88 @@
+//============================================================================
+// Name        : ligand_cost.cc
+// Author      : Fabian Mora
+// Version     : 1.0
+// License     : MIT license
+// Description :
+//============================================================================
+
+#include <algorithm>
+#include <sstream>
+#include "ligand_cost.hh"
+#include "../io/ligand_library.hh"
+
+namespace MPIBatch {
+// Counts the atoms but the non-polar hydrogens, which vina merges, and the active torsions (BRANCH
+// records), falling back to TORSDOF
+const LigandCostModel::features_t& LigandCostModel::features(const std::string &ligand) {
+    auto it = __features__.find(ligand);
+    if (it != __features__.end())
+        return it->second;
+    features_t result;
+    double branches = 0;
+    double torsdof = 0;
+    std::string contents;
+    read_ligand(ligand, contents);
+    std::istringstream file(contents);
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.compare(0, 4, "ATOM") == 0 || line.compare(0, 6, "HETATM") == 0) {
+            std::istringstream fields(line.size() > 77 ? line.substr(77) : std::string());
+            std::string type;
+            fields >> type;
+            if (type != "H")
+                result.atoms += 1;
+        } else if (line.compare(0, 6, "BRANCH") == 0)
+            branches += 1;
+        else if (line.compare(0, 7, "TORSDOF") == 0)
+            std::istringstream(line.substr(7)) >> torsdof;
+    }
+    double torsions = (branches > 0) ? branches : torsdof;
+    double degrees_of_freedom = 6 + torsions; // position, orientation and torsions
+    result.steps = 70 * 3 * (50 + result.atoms + 10 * degrees_of_freedom) / 2;
+    return __features__.emplace(ligand, result).first->second;
+}
+
+double LigandCostModel::estimate(const std::string &ligand) {
+    const features_t &x = features(ligand);
+    return __weights__[0] * x.steps + __weights__[1] * x.steps * x.atoms;
+}
+
+bool LigandCostModel::observe(const std::vector <std::string*> &ligands, duration time) {
+    double x0 = 0;
+    double x1 = 0;
+    for (const std::string *ligand : ligands) {
+        const features_t &x = features(*ligand);
+        x0 += x.steps;
+        x1 += x.steps * x.atoms;
+        __features__.erase(*ligand);
+    }
+    double y = time.count();
+    __normal__[0] += x0 * x0;
+    __normal__[1] += x0 * x1;
+    __normal__[2] += x1 * x1;
+    __moments__[0] += x0 * y;
+    __moments__[1] += x1 * y;
+    if (++__observations__ < __next_fit__)
+        return false;
+    __next_fit__ *= 2;
+    fit();
+    return true;
+}
+
+// Solves the normal equations, with a single weight on steps * atoms when they are singular or give a
+// negative weight
+void LigandCostModel::fit() {
+    double det = __normal__[0] * __normal__[2] - __normal__[1] * __normal__[1];
+    if (det > 1e-9 * __normal__[0] * __normal__[2]) {
+        double w0 = (__moments__[0] * __normal__[2] - __moments__[1] * __normal__[1]) / det;
+        double w1 = (__moments__[1] * __normal__[0] - __moments__[0] * __normal__[1]) / det;
+        if (w0 >= 0 && w1 >= 0) {
+            __weights__ = { w0, w1 };
+            return;
+        }
+    }
+    if (__normal__[2] > 0)
+        __weights__ = { 0, std::max(__moments__[1] / __normal__[2], 0.0) };
+}
+}
@@ -0,0 +1,47 @@
+//============================================================================
+// Name        : ligand_cost.hh
+// Author      : Fabian Mora
+// Version     : 1.0
+// License     : MIT license
+// Description :
+//============================================================================
+
+#ifndef __LIGAND_COST_HH__
+#define __LIGAND_COST_HH__
+
+#include <array>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../definitions.hh"
+
+namespace MPIBatch {
+// Estimates the docking time of a ligand from its PDBQT file: vina runs a number of Monte Carlo steps
+// that grows with the atoms and the torsions (the num_steps heuristic of main_procedure), and a step
+// costs about one evaluation per atom. The time is modeled as w0 * steps + w1 * steps * atoms, the
+// weights are fitted by least squares to the measured batch times.
+class LigandCostModel {
+private:
+    struct features_t {
+        double steps = 0;
+        double atoms = 0;
+    };
+    std::unordered_map <std::string, features_t> __features__; // of the queued and running ligands
+    std::array <double, 2> __weights__ = { 0, 1 }; // steps * atoms until the first measurement
+    std::array <double, 3> __normal__ = { 0, 0, 0 }; // sums of x0 * x0, x0 * x1 and x1 * x1
+    std::array <double, 2> __moments__ = { 0, 0 }; // sums of x0 * y and x1 * y
+    size_t __observations__ = 0;
+    size_t __next_fit__ = 1;
+
+    const features_t& features(const std::string &ligand);
+    void fit();
+public:
+    double estimate(const std::string &ligand);
+    // Adds the measured time of a batch, returns whether the weights were refitted; they are after 1,
+    // 2, 4, 8... batches so that the queue is reordered a logarithmic number of times. The ligands of
+    // the batch are done, their features are dropped
+    bool observe(const std::vector <std::string*> &ligands, duration time);
+};
+}
+#endif
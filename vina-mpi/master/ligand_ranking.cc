@@ -0,0 +1,109 @@
+//============================================================================
+// Name        : ligand_ranking.cc
+// Author      : Fabian Mora
+// Version     : 1.0
+// License     : MIT license
+// Description :
+//============================================================================
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include "ligand_ranking.hh"
+
+namespace MPIBatch {
+LigandRanking::LigandRanking(size_t capacity, bool keep_models) :
+        __capacity__(capacity), __keep_models__(keep_models) {
+}
+
+bool LigandRanking::better(const entry_t &x, const entry_t &y) {
+    return (x.score < y.score) || (x.score == y.score && x.task_id < y.task_id);
+}
+
+bool LigandRanking::add(const std::string &task, int64_t task_id, task_result_t &result) {
+    ++__reported__;
+    if (result.status != 0 || result.modes <= 0) {
+        ++__failed__;
+        return false;
+    }
+    if (__capacity__ == 0)
+        return false;
+    entry_t entry;
+    entry.score = result.score;
+    entry.seconds = result.seconds;
+    entry.modes = result.modes;
+    entry.task_id = task_id;
+    if (__heap__.size() == __capacity__) {
+        if (!better(entry, __heap__.front()))
+            return false;
+        std::pop_heap(__heap__.begin(), __heap__.end(), better);
+        __heap__.pop_back();
+    }
+    entry.task = task;
+    if (__keep_models__)
+        entry.models = std::move(result.payload);
+    __heap__.push_back(std::move(entry));
+    std::push_heap(__heap__.begin(), __heap__.end(), better);
+    return true;
+}
+
+size_t LigandRanking::size() const {
+    return __heap__.size();
+}
+
+size_t LigandRanking::reported() const {
+    return __reported__;
+}
+
+size_t LigandRanking::failed() const {
+    return __failed__;
+}
+
+double LigandRanking::bound() const {
+    if (__capacity__ == 0 || __heap__.size() < __capacity__)
+        return std::numeric_limits <double>::infinity();
+    return __heap__.front().score;
+}
+
+std::vector <LigandRanking::entry_t> LigandRanking::ranked() const {
+    std::vector <entry_t> entries = __heap__;
+    std::sort_heap(entries.begin(), entries.end(), better);
+    return entries;
+}
+
+void LigandRanking::write(const std::string &path,
+        const std::function <std::string(const std::string&)> &name) const {
+    std::ofstream table(path);
+    if (!table)
+        throw(std::runtime_error("Couldn't open the ranking " + path));
+    table << "rank\tligand\taffinity\tmodes\tseconds\n";
+    size_t rank = 0;
+    for (const entry_t &entry : ranked())
+        table << ++rank << '\t' << name(entry.task) << '\t' << entry.score << '\t' << entry.modes << '\t'
+                << entry.seconds << '\n';
+}
+
+size_t LigandRanking::write_models(const std::function <std::string(const std::string&)> &path) const {
+    size_t count = 0;
+    for (const entry_t &entry : __heap__) {
+        if (entry.models.empty())
+            continue;
+        std::string model_path = path(entry.task);
+        std::ofstream file(model_path, std::ios::out | std::ios::binary | std::ios::trunc);
+        file.write(entry.models.data(), entry.models.size());
+        if (!file)
+            throw(std::runtime_error("Couldn't write " + model_path));
+        ++count;
+    }
+    return count;
+}
+
+int affinity_bound(double affinity) {
+    double bound = std::ceil(affinity * 1000);
+    if (!(bound < static_cast <double>(no_bound)))
+        return no_bound;
+    return static_cast <int>(std::max(bound, static_cast <double>(INT_MIN)));
+}
+}
@@ -0,0 +1,67 @@
+//============================================================================
+// Name        : ligand_ranking.hh
+// Author      : Fabian Mora
+// Version     : 1.0
+// License     : MIT license
+// Description :
+//============================================================================
+
+#ifndef __LIGAND_RANKING_HH__
+#define __LIGAND_RANKING_HH__
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "../definitions.hh"
+#include "../serializers/result_serializer.hh"
+
+namespace MPIBatch {
+// The capacity ligands with the best (lowest) affinity reported so far, kept in a heap with the worst
+// of them on top, so a result costs O(log capacity) and the memory doesn't grow with the library. Equal
+// affinities are ranked by task id. With keep_models the output models of the ranked ligands are kept,
+// those of a ligand are dropped when it leaves the ranking.
+// The workers get the affinity a ligand has to match to enter the ranking with the status replies, in
+// thousandths of kcal/mol rounded up (see affinity_bound), and send the models of those that do only.
+class LigandRanking {
+public:
+    struct entry_t {
+        double score = 0;
+        double seconds = 0;
+        int modes = 0;
+        int64_t task_id = 0;
+        std::string task;
+        std::string models;
+    };
+private:
+    std::vector <entry_t> __heap__;
+    size_t __capacity__ = 0;
+    bool __keep_models__ = false;
+    size_t __reported__ = 0;
+    size_t __failed__ = 0;
+
+    static bool better(const entry_t &x, const entry_t &y);
+public:
+    LigandRanking(size_t capacity = 0, bool keep_models = false);
+
+    // Whether the ligand entered the ranking
+    bool add(const std::string &task, int64_t task_id, task_result_t &result);
+
+    size_t size() const;
+    size_t reported() const; // results added, failed ones included
+    size_t failed() const;
+    // The affinity of the worst ranked ligand once the ranking is full, infinity before
+    double bound() const;
+    std::vector <entry_t> ranked() const; // best first
+
+    // Writes "rank ligand affinity modes seconds" lines, best first
+    void write(const std::string &path, const std::function <std::string(const std::string&)> &name) const;
+    // Writes the kept models of every ranked ligand to the path returned for its task, returns how many
+    size_t write_models(const std::function <std::string(const std::string&)> &path) const;
+};
+
+// The bound sent to the workers for an affinity, no_bound for infinity; a ligand with a lower affinity
+// has a lower or equal bound
+int affinity_bound(double affinity);
+}
+#endif
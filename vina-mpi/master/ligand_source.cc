@@ -0,0 +1,115 @@
+//============================================================================
+// Name        : ligand_source.cc
+// Author      : Fabian Mora
+// Version     : 1.0
+// License     : MIT license
+// Description :
+//============================================================================
+
+#include <algorithm>
+#include <cctype>
+#include "ligand_source.hh"
+
+namespace MPIBatch {
+namespace {
+bool pdbqt_extensionQ(const std::filesystem::path &path) {
+    std::string ext = path.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) {
+        return std::tolower(c);
+    });
+    return ext == ".pdbqt";
+}
+}
+
+LigandSource::LigandSource(const std::string &path) {
+    add(path);
+}
+
+void LigandSource::add(const std::string &path) {
+    __paths__.push_back(std::filesystem::path(path));
+}
+
+void LigandSource::set_filter(const filter_t &filter) {
+    __filter__ = filter;
+}
+
+// A ligand file is returned as is, a library is opened and enumerated by the next calls. Only the
+// files given or listed are probed, those in a directory are ligands: probing opens every file
+bool LigandSource::ligand(const std::filesystem::path &path, std::string &ligand) {
+    if (ligand_libraryQ(path.string())) {
+        __library__.reset(new LigandLibrary(path.string()));
+        return false;
+    }
+    ligand = path.string();
+    return true;
+}
+
+bool LigandSource::next_path(std::string &ligand) {
+    namespace fs = std::filesystem;
+    std::error_code error;
+    while (true) {
+        if (__library__) {
+            if (__library__->next(ligand))
+                return true;
+            __library__.reset();
+        } else if (__directory__ != fs::directory_iterator()) {
+            const fs::directory_entry entry = *__directory__;
+            __directory__.increment(error);
+            if (error)
+                __directory__ = fs::directory_iterator();
+            if (pdbqt_extensionQ(entry.path())) {
+                ligand = entry.path().string();
+                return true;
+            }
+        } else if (__list__.is_open()) {
+            std::string line;
+            if (!std::getline(__list__, line)) {
+                __list__.close();
+                continue;
+            }
+            size_t begin = line.find_first_not_of(" \t\r");
+            size_t end = line.find_last_not_of(" \t\r");
+            if (begin == std::string::npos || line[begin] == '#')
+                continue;
+            fs::path path = line.substr(begin, end - begin + 1);
+            if (path.is_relative())
+                path = __list_dir__ / path;
+            if (fs::is_directory(path, error))
+                __paths__.push_back(path);
+            else if (this->ligand(path, ligand))
+                return true;
+        } else if (!__paths__.empty()) {
+            fs::path path = __paths__.front();
+            __paths__.pop_front();
+            if (fs::is_directory(path, error))
+                __directory__ = fs::directory_iterator(path, error);
+            else if (pdbqt_extensionQ(path)) {
+                if (this->ligand(path, ligand))
+                    return true;
+            } else if (fs::is_regular_file(path, error)) {
+                __list__.open(path);
+                __list_dir__ = path.parent_path();
+            }
+        } else
+            return false;
+    }
+}
+
+bool LigandSource::next(std::string &ligand) {
+    while (next_path(ligand)) {
+        ++__enumerated__;
+        if (!__filter__ || __filter__(ligand))
+            return true;
+        ++__skipped__;
+    }
+    return false;
+}
+
+size_t LigandSource::enumerated() const {
+    return __enumerated__;
+}
+
+size_t LigandSource::skipped() const {
+    return __skipped__;
+}
+}
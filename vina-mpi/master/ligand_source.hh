@@ -0,0 +1,55 @@
+//============================================================================
+// Name        : ligand_source.hh
+// Author      : Fabian Mora
+// Version     : 1.0
+// License     : MIT license
+// Description :
+//============================================================================
+
+#ifndef __LIGAND_SOURCE_HH__
+#define __LIGAND_SOURCE_HH__
+
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <string>
+#include "../io/ligand_library.hh"
+
+namespace MPIBatch {
+// Enumerates the ligands one at a time, so that the master never holds the whole library. A path is
+// a PDBQT file, a directory, whose PDBQT files are listed, or a list of ligands: a text file with one
+// PDBQT file or directory per line, relative to the list; empty lines and lines starting with # are
+// skipped. The directories listed are enumerated once the list is done. A PDBQT file given or listed
+// that starts with a MODEL record is a multi-molecule library, enumerated a molecule at a time from
+// its index; the files of a directory are always single ligands.
+class LigandSource {
+public:
+    using filter_t = std::function <bool(const std::string&)>; // false to skip the ligand
+private:
+    std::deque <std::filesystem::path> __paths__;
+    std::filesystem::directory_iterator __directory__;
+    std::ifstream __list__;
+    std::filesystem::path __list_dir__;
+    std::unique_ptr <LigandLibrary> __library__;
+    filter_t __filter__;
+    size_t __enumerated__ = 0;
+    size_t __skipped__ = 0;
+
+    bool next_path(std::string &ligand);
+    bool ligand(const std::filesystem::path &path, std::string &ligand);
+public:
+    LigandSource() = default;
+    LigandSource(const std::string &path);
+
+    void add(const std::string &path);
+    void set_filter(const filter_t &filter);
+    // Sets the next ligand, returns false once there are no more
+    bool next(std::string &ligand);
+
+    size_t enumerated() const;
+    size_t skipped() const;
+};
+}
+#endif
@@ -11,9 +11,11 @@
 
 #include <algorithm>
 #include <chrono>
+#include <functional>
 #include <map>
 #include <string>
 #include <thread>
+#include <vector>
 #include <mpi.h>
 
 #include "../definitions.hh"
@@ -21,13 +23,41 @@
 #include "../io/logger.hh"
 #include "../util/mpi.hh"
 #include "../util/util.hh"
+#include "../serializers/result_serializer.hh"
+#include "journal.hh"
 
 namespace MPIBatch {
+// The master keeps every outstanding request in one array and reacts to whichever completes, with
+// MPI_Testsome: a status receive is pre-posted for every worker, and when it completes the reply (and
+// the tasks, if any) is sent right away without waiting on any other worker.
+// A worker may hold more than one batch: it runs several slots, and each slot asks for its next batch
+// while the current one runs.
+// Tasks are sent in batches of up to max_batch, sized so that a batch takes about batch_target_duration
+// given the time per task observed so far.
+// A worker sends the results of a batch right before reporting it finished, they are received with the
+// status and passed to the result observer along with the tasks, matched by their position in the batch;
+// the tasks without a result, when the worker's task threw, are passed a failed one (status -1).
+// Every status reply carries the bound returned by the bound function, the workers may use it to leave
+// out what the master would drop, e.g. the models of the ligands that can't enter a ranking.
 template <typename TaskQueue, ServerMode mode>
 class MasterProcess {
 public:
     using node_t = Node<typename TaskQueue::task_info_t>;
+    // Called with the tasks of every batch that finished and the time the batch took
+    using batch_observer_t = std::function <void(const std::vector <typename TaskQueue::task_t*>&, duration)>;
+    // Called with every task a worker reported a result for, its id and the result
+    using result_observer_t = std::function <void(typename TaskQueue::task_t*, int64_t, task_result_t&)>;
+    // Returns the bound sent with the status replies
+    using bound_t = std::function <int()>;
 private:
+    // Request slots, the array holds request_kinds blocks of one request per worker
+    enum RequestKind : int {
+        send_status_request = 0,
+        send_data_request,
+        recv_status_request,
+        request_kinds
+    };
+
     // MPI information
     int rank = -1;
     int rank_size = -1;
@@ -36,21 +66,43 @@ private:
 
     // Internal data members
     std::map <int, node_t> nodes = std::map <int, node_t>();
+    std::vector <MPI_Request> requests = std::vector <MPI_Request>();
+    std::vector <int> completed_requests = std::vector <int>();
     TaskQueue __queue__;
     Logger __logger__;
 
+    // Batching
+    size_t max_batch = 1;
+    size_t timed_batches = 0;
+    duration task_duration = duration(0);
+    batch_observer_t batch_observer = batch_observer_t();
+    result_observer_t result_observer = result_observer_t();
+    bound_t reply_bound = bound_t();
+
+    // Dispatched and completed tasks, for restarts
+    TaskJournal *journal = nullptr;
+
     // Private function members
     bool active_workerQ(int worker_rank);
     size_t active_workers();
+    bool workers_stopped();
+    size_t batch_size();
+    void time_batch(const typename node_t::batch_t &batch);
 
+    MPI_Request& request(int worker_rank, RequestKind kind);
     void init_channels();
-    bool recv_status(int worker_rank, duration timeout, duration sleep);
-    bool send_status(int worker_rank, duration timeout, duration sleep);
+    void close_channels(bool wait_sends);
+    void recv_status(int worker_rank);
+    void send_status(int worker_rank);
+    std::vector <task_result_t> recv_results(int worker_rank);
+    template <typename Serializer>
+    void send_data(Serializer &serializer, int worker_rank);
+    template <typename Serializer>
+    void data_sent(Serializer &serializer, int worker_rank);
     template <typename Serializer>
-    bool send_data(Serializer &serializer, int worker_rank, duration timeout, duration sleep);
-    bool respond_worker(int worker_rank, duration timeout, duration sleep);
+    void respond_worker(Serializer &serializer, int worker_rank);
     template <typename Serializer>
-    void full_cycle(Serializer &serializer, int worker_rank, duration timeout, duration sleep);
+    size_t progress(Serializer &serializer, time_point &last_ping);
 public:
     MasterProcess(std::string log_path = "", MPI_Comm communicator = MPI_COMM_WORLD,
             const TaskQueue &queue = TaskQueue());
@@ -66,6 +118,11 @@ public:
     Logger& logger();
 
     void move_queue(TaskQueue &queue);
+    void set_batch_size(size_t max_batch);
+    void set_batch_observer(const batch_observer_t &observer);
+    void set_result_observer(const result_observer_t &observer);
+    void set_reply_bound(const bound_t &bound);
+    void set_journal(TaskJournal *journal);
 
     template <typename Serializer>
     int run(Serializer &serializer, const duration &report_interval);
@@ -98,28 +155,20 @@ inline MasterProcess <TaskQueue, mode>::MasterProcess(std::string log_path, MPI_
             nodes[i].state = NodeState::booting;
         }
         nodes[0].status = WorkerStatus::available;
+        requests.assign(request_kinds * (rank_size - 1), MPI_REQUEST_NULL);
+        completed_requests.resize(requests.size());
     }
 }
 
 template <typename TaskQueue, ServerMode mode>
 inline MasterProcess <TaskQueue, mode>::~MasterProcess() {
-    for (int worker_rank = 1; worker_rank < rank_size; ++worker_rank) {
-        nodes[worker_rank].state = NodeState::cleaning;
-        terminate_request <true, false>(__logger__, &(nodes[worker_rank].send_status),
-                nodes[worker_rank].send_status_s);
-        terminate_request <true, false>(__logger__, &(nodes[worker_rank].recv_status),
-                nodes[worker_rank].recv_status_s);
-        terminate_request <true, false>(__logger__, &(nodes[worker_rank].send_data),
-                nodes[worker_rank].send_data_s);
-        terminate_request <true, false>(__logger__, &(nodes[worker_rank].recv_data),
-                nodes[worker_rank].recv_data_s);
-        nodes[worker_rank].clear();
-    }
+    close_channels(false);
     rank = -1;
     rank_size = 0;
     hostname = "";
     communicator = MPI_COMM_NULL;
     nodes.clear();
+    requests.clear();
 }
 
 template <typename TaskQueue, ServerMode mode>
@@ -136,162 +185,273 @@ inline size_t MasterProcess <TaskQueue, mode>::active_workers() {
     return workers;
 }
 
+// Whether every worker was told to stop, which only happens once the queue is empty
+template <typename TaskQueue, ServerMode mode>
+inline bool MasterProcess <TaskQueue, mode>::workers_stopped() {
+    for (size_t i = 1; i < nodes.size(); ++i)
+        if (nodes[i].status != WorkerStatus::killed)
+            return false;
+    return true;
+}
+
+template <typename TaskQueue, ServerMode mode>
+inline size_t MasterProcess <TaskQueue, mode>::batch_size() {
+    if (max_batch <= 1 || timed_batches == 0)
+        return 1;
+    size_t batch = std::clamp(static_cast <size_t>(batch_target_duration / task_duration), size_t(1),
+            max_batch);
+    // Near the end of the queue, leave some tasks for every worker
+    size_t remaining = std::get <2>(__queue__.status());
+    return std::min(batch, std::max(remaining / std::max(active_workers(), size_t(1)), size_t(1)));
+}
+
+template <typename TaskQueue, ServerMode mode>
+inline void MasterProcess <TaskQueue, mode>::time_batch(const typename node_t::batch_t &batch) {
+    if (batch.tasks.empty())
+        return;
+    duration batch_duration = elapsed(now(), batch.dispatch_time);
+    if (batch_observer) {
+        std::vector <typename TaskQueue::task_t*> tasks;
+        for (auto &task : batch.tasks)
+            tasks.push_back(task.first);
+        batch_observer(tasks, batch_duration);
+    }
+    duration per_task = batch_duration / static_cast <double>(batch.tasks.size());
+    task_duration = (timed_batches == 0) ? per_task : 0.8 * task_duration + 0.2 * per_task;
+    ++timed_batches;
+}
+
+template <typename TaskQueue, ServerMode mode>
+inline MPI_Request& MasterProcess <TaskQueue, mode>::request(int worker_rank, RequestKind kind) {
+    return requests[static_cast <size_t>(kind) * (rank_size - 1) + (worker_rank - 1)];
+}
+
 template <typename TaskQueue, ServerMode mode>
 inline void MasterProcess <TaskQueue, mode>::init_channels() {
     for (int worker_rank = 1; worker_rank < rank_size; ++worker_rank) {
-        void *status_address = nodes[worker_rank].status_addr();
-        MPI_Request *request = &(nodes[worker_rank].recv_status);
+        node_t &node = nodes[worker_rank];
         mpi_error <true>(__logger__,
-                MPI_Recv_init(status_address, 1, MPI_INT, worker_rank, node_t::w2m_status_tag,
-                        communicator, request));
-        nodes[worker_rank].recv_status_s = RequestStatus::active;
-        status_address = nodes[worker_rank].status_buffer_addr();
-        request = &(nodes[worker_rank].send_status);
+                MPI_Recv_init(node.status_addr(), node_t::status_count, MPI_INT, worker_rank, node_t::w2m_status_tag,
+                        communicator, &request(worker_rank, recv_status_request)));
+        node.recv_status_s = RequestStatus::active;
         mpi_error <true>(__logger__,
-                MPI_Send_init(status_address, 1, MPI_INT, worker_rank, node_t::m2w_status_tag,
-                        communicator, request));
-        nodes[worker_rank].send_status_s = RequestStatus::active;
-        nodes[worker_rank].state = NodeState::ready;
+                MPI_Send_init(node.status_buffer_addr(), node_t::status_count, MPI_INT, worker_rank, node_t::m2w_status_tag,
+                        communicator, &request(worker_rank, send_status_request)));
+        node.send_status_s = RequestStatus::active;
+        node.state = NodeState::ready;
+        recv_status(worker_rank);
     }
 }
 
+// Frees the requests, after waiting for the replies still in flight when wait_sends is set. The
+// receives that are still posted are canceled.
 template <typename TaskQueue, ServerMode mode>
-inline bool MasterProcess <TaskQueue, mode>::recv_status(int worker_rank, duration timeout,
-        duration sleep) {
-    WorkerStatus worker_status = nodes[worker_rank].status;
-    MPI_Request *request = &(nodes[worker_rank].recv_status);
-    nodes[worker_rank].state = NodeState::receiving_status;
-    if (nodes[worker_rank].recv_status_s == RequestStatus::active) {
-        mpi_error <true>(__logger__, MPI_Start(request));
-        nodes[worker_rank].recv_status_s = RequestStatus::started;
-    }
-    if (nodes[worker_rank].recv_status_s == RequestStatus::started) {
-        bool result = try_request(__logger__, request, timeout, sleep);
-        if (worker_status == WorkerStatus::unknown && active_workerQ(worker_rank))
-            __logger__(LogType::info, "Worker: ", worker_rank, " has come to life");
-        if (result) {
-            nodes[worker_rank].recv_status_s = RequestStatus::active;
-            nodes[worker_rank].state = NodeState::receiving_status_complete;
+inline void MasterProcess <TaskQueue, mode>::close_channels(bool wait_sends) {
+    if (requests.empty())
+        return;
+    for (int worker_rank = 1; worker_rank < rank_size; ++worker_rank) {
+        node_t &node = nodes[worker_rank];
+        if (node.state == NodeState::terminated)
+            continue;
+        node.state = NodeState::cleaning;
+        if (wait_sends) {
+            if (node.send_status_s == RequestStatus::started)
+                mpi_error <false>(__logger__,
+                        MPI_Wait(&request(worker_rank, send_status_request), MPI_STATUS_IGNORE));
+            if (node.send_data_s == RequestStatus::nonblocking)
+                mpi_error <false>(__logger__,
+                        MPI_Wait(&request(worker_rank, send_data_request), MPI_STATUS_IGNORE));
+            if (node.send_status_s == RequestStatus::started)
+                node.send_status_s = RequestStatus::active;
+            node.send_data_s = RequestStatus::null;
         }
-        return result;
+        terminate_request <true, false>(__logger__, &request(worker_rank, send_status_request),
+                node.send_status_s);
+        terminate_request <true, false>(__logger__, &request(worker_rank, recv_status_request),
+                node.recv_status_s);
+        terminate_request <true, false>(__logger__, &request(worker_rank, send_data_request),
+                node.send_data_s);
+        node.clear();
     }
-    return false;
 }
 
 template <typename TaskQueue, ServerMode mode>
-inline bool MasterProcess <TaskQueue, mode>::send_status(int worker_rank, duration timeout,
-        duration sleep) {
-    MPI_Request *request = &(nodes[worker_rank].send_status);
-    nodes[worker_rank].state = NodeState::sending_status;
-    if (nodes[worker_rank].send_status_s == RequestStatus::active) {
-        nodes[worker_rank].sync();
-        mpi_error <true>(__logger__, MPI_Start(request));
-        nodes[worker_rank].send_status_s = RequestStatus::started;
+inline void MasterProcess <TaskQueue, mode>::recv_status(int worker_rank) {
+    node_t &node = nodes[worker_rank];
+    if (node.recv_status_s == RequestStatus::active) {
+        mpi_error <true>(__logger__, MPI_Start(&request(worker_rank, recv_status_request)));
+        node.recv_status_s = RequestStatus::started;
+        node.state = NodeState::receiving_status;
     }
-    if (nodes[worker_rank].send_status_s == RequestStatus::started) {
-        bool result = try_request(__logger__, request, timeout, sleep);
-        if (result) {
-            nodes[worker_rank].send_status_s = RequestStatus::active;
-            nodes[worker_rank].state = NodeState::sending_status_complete;
-        }
-        return result;
+}
+
+template <typename TaskQueue, ServerMode mode>
+inline void MasterProcess <TaskQueue, mode>::send_status(int worker_rank) {
+    node_t &node = nodes[worker_rank];
+    MPI_Request *send_request = &request(worker_rank, send_status_request);
+    if (node.send_status_s == RequestStatus::started) { // the worker already has the last reply, so this returns at once
+        mpi_error <true>(__logger__, MPI_Wait(send_request, MPI_STATUS_IGNORE));
+        node.send_status_s = RequestStatus::active;
     }
-    return false;
+    node.bound = reply_bound ? reply_bound() : no_bound;
+    node.sync();
+    mpi_error <true>(__logger__, MPI_Start(send_request));
+    node.send_status_s = RequestStatus::started;
+    node.state = NodeState::sending_status;
+}
+
+// The worker started sending the results before its finished status, so this doesn't block for long
+template <typename TaskQueue, ServerMode mode>
+inline std::vector <task_result_t> MasterProcess <TaskQueue, mode>::recv_results(int worker_rank) {
+    MPI_Status mpi_status = MPI_Status();
+    mpi_error <true>(__logger__, MPI_Probe(worker_rank, node_t::results_tag, communicator, &mpi_status));
+    int size = 0;
+    mpi_error <true>(__logger__, MPI_Get_count(&mpi_status, MPI_BYTE, &size));
+    std::string message(static_cast <size_t>(size), '\0');
+    mpi_error <true>(__logger__,
+            MPI_Recv(message.data(), size, MPI_BYTE, worker_rank, node_t::results_tag, communicator,
+                    MPI_STATUS_IGNORE));
+    return ResultSerializer::unpack(message);
 }
 
 template <typename TaskQueue, ServerMode mode>
 template <typename Serializer>
-inline bool MasterProcess <TaskQueue, mode>::send_data(Serializer &serializer, int worker_rank,
-        duration timeout, duration sleep) {
+inline void MasterProcess <TaskQueue, mode>::send_data(Serializer &serializer, int worker_rank) {
     node_t &node = nodes[worker_rank];
-    if (node.task_info.first != nullptr) {
-        MPI_Request *request = &(node.send_data);
-        node.state = NodeState::sending_data;
-        if (node.send_data_s == RequestStatus::null) {
-            auto serialized_data = serializer(*(node.task_info).first);
-            if ((std::get <1>(serialized_data) > 0) && (std::get <0>(serialized_data) != nullptr)) {
-                mpi_error <true>(__logger__,
-                        MPI_Isend(std::get <0>(serialized_data), std::get <1>(serialized_data),
-                                std::get <2>(serialized_data), worker_rank, node_t::recv_data_tag,
-                                communicator, request));
-                node.serialization_id = std::get <3>(serialized_data);
-                node.send_data_s = RequestStatus::nonblocking;
-            } else {
-                node.send_data_s = RequestStatus::null;
-                node.send_data = MPI_REQUEST_NULL;
-                node.state = NodeState::sending_data_complete;
-                serializer.free(node.serialization_id);
-                node.serialization_id = invalid_task_id;
-            }
-        }
-        if (node.send_data_s == RequestStatus::nonblocking) {
-            bool result = try_request(__logger__, request, timeout, sleep);
-            if (result) {
-                node.send_data_s = RequestStatus::null;
-                node.send_data = MPI_REQUEST_NULL;
-                node.state = NodeState::sending_data_complete;
-                serializer.free(node.serialization_id);
-                node.serialization_id = invalid_task_id;
-            }
-            return result;
-        }
+    MPI_Request *send_request = &request(worker_rank, send_data_request);
+    if (node.send_data_s == RequestStatus::nonblocking) { // the worker received the last task before reporting again
+        mpi_error <true>(__logger__, MPI_Wait(send_request, MPI_STATUS_IGNORE));
+        data_sent(serializer, worker_rank);
     }
-    return false;
+    if (node.batches.empty())
+        return;
+    std::vector <typename TaskQueue::task_t> batch;
+    for (auto &task : node.batches.back().tasks)
+        batch.push_back(*(task.first));
+    auto serialized_data = serializer(batch);
+    node.serialization_id = std::get <3>(serialized_data);
+    if ((std::get <1>(serialized_data) > 0) && (std::get <0>(serialized_data) != nullptr)) {
+        mpi_error <true>(__logger__,
+                MPI_Isend(std::get <0>(serialized_data), std::get <1>(serialized_data),
+                        std::get <2>(serialized_data), worker_rank, node_t::recv_data_tag,
+                        communicator, send_request));
+        node.send_data_s = RequestStatus::nonblocking;
+        node.state = NodeState::sending_data;
+    } else
+        data_sent(serializer, worker_rank);
+}
+
+template <typename TaskQueue, ServerMode mode>
+template <typename Serializer>
+inline void MasterProcess <TaskQueue, mode>::data_sent(Serializer &serializer, int worker_rank) {
+    node_t &node = nodes[worker_rank];
+    node.send_data_s = RequestStatus::null;
+    request(worker_rank, send_data_request) = MPI_REQUEST_NULL;
+    serializer.free(node.serialization_id);
+    node.serialization_id = invalid_task_id;
+    node.state = NodeState::sending_data_complete;
 }
 
+// Replies to the status the worker just sent. A finished status completes the oldest batch of the
+// slot it names, and both available and finished mean that slot has room for one more batch: it gets
+// a new one, the order to stop if the worker holds nothing and the queue is empty, or wait otherwise.
+// A running status is acknowledged. The receive is posted again unless the worker was told to stop.
 template <typename TaskQueue, ServerMode mode>
-inline bool MasterProcess <TaskQueue, mode>::respond_worker(int worker_rank, duration timeout,
-        duration sleep) {
+template <typename Serializer>
+inline void MasterProcess <TaskQueue, mode>::respond_worker(Serializer &serializer, int worker_rank) {
     node_t &node = nodes[worker_rank];
     WorkerStatus &worker_status = node.status;
-    bool msg_sent = false;
+    node.state = NodeState::receiving_status_complete;
     if (worker_status == WorkerStatus::finished) {
-        node.scheduled = false;
-        __queue__.completed(node.task_info.second);
+        std::vector <task_result_t> results = recv_results(worker_rank);
+        auto same_slot = [&node](const typename node_t::batch_t &batch) {
+            return batch.slot == node.slot;
+        };
+        auto batch = std::find_if(node.batches.begin(), node.batches.end(), same_slot);
+        if (batch != node.batches.end()) {
+            time_batch(*batch);
+            if (result_observer) {
+                task_result_t failed;
+                failed.status = -1;
+                results.resize(batch->tasks.size(), failed);
+                for (size_t i = 0; i < batch->tasks.size(); ++i)
+                    result_observer(batch->tasks[i].first, batch->tasks[i].second, results[i]);
+            }
+            for (auto &task : batch->tasks) {
+                if (journal)
+                    journal->completed(task.second, *(task.first));
+                __queue__.completed(task.second);
+            }
+            batch = node.batches.erase(batch);
+            // A prefetched batch only starts now, the time it spent queued is not docking time
+            auto next = std::find_if(batch, node.batches.end(), same_slot);
+            if (next != node.batches.end())
+                next->dispatch_time = now();
+        }
     }
     if ((worker_status == WorkerStatus::available) || (worker_status == WorkerStatus::finished)) {
-        node.clear_task_info();
         if (__queue__.available_tasks()) {
-            node.scheduled = true;
             worker_status = WorkerStatus::available;
-            node.task_info = __queue__.pop();
-            msg_sent = send_status(worker_rank, timeout, sleep);
-        } else if (__queue__.empty() && active_workerQ(worker_rank)) {
-            node.scheduled = false;
+            node.batches.push_back( { __queue__.pop(batch_size()), now(), node.slot });
+            if (journal)
+                for (auto &task : node.batches.back().tasks)
+                    journal->dispatched(task.second, *(task.first));
+            send_status(worker_rank);
+            send_data(serializer, worker_rank);
+        } else if (__queue__.empty() && node.batches.empty() && active_workerQ(worker_rank)) {
             worker_status = WorkerStatus::killed;
-            msg_sent = send_status(worker_rank, timeout, sleep);
+            send_status(worker_rank);
+        } else {
+            worker_status = WorkerStatus::wait;
+            send_status(worker_rank);
         }
     } else if (worker_status == WorkerStatus::running) {
-        msg_sent = send_status(worker_rank, timeout, sleep);
+        send_status(worker_rank);
     }
-    return msg_sent;
+    node.scheduled = !node.batches.empty();
+    if (active_workerQ(worker_rank))
+        recv_status(worker_rank);
 }
 
+// Handles the requests that completed since the last call, returns how many did. The replies sent
+// before are handled first, so that a worker's status is only answered once its last reply is done.
 template <typename TaskQueue, ServerMode mode>
 template <typename Serializer>
-inline void MasterProcess <TaskQueue, mode>::full_cycle(Serializer &serializer, int worker_rank,
-        duration timeout, duration sleep) {
-    node_t &node = nodes[worker_rank];
-    if (node.state == NodeState::ready || node.state == NodeState::receiving_status)
-        recv_status(worker_rank, timeout, sleep);
-    if (node.state == NodeState::receiving_status_complete)
-        respond_worker(worker_rank, timeout, sleep);
-    else if (node.state == NodeState::sending_status)
-        send_status(worker_rank, timeout, sleep);
-    if (node.state == NodeState::sending_status_complete) {
-        if (node.status != WorkerStatus::running && active_workerQ(worker_rank) && node.scheduled)
-            send_data(serializer, worker_rank, timeout, sleep);
-        else {
-            node.state = NodeState::ready;
-            node.active_cycle = false;
+inline size_t MasterProcess <TaskQueue, mode>::progress(Serializer &serializer, time_point &last_ping) {
+    int count = 0;
+    mpi_error <true>(__logger__,
+            MPI_Testsome(static_cast <int>(requests.size()), requests.data(), &count,
+                    completed_requests.data(), MPI_STATUSES_IGNORE));
+    if (count == MPI_UNDEFINED || count == 0)
+        return 0;
+    std::sort(completed_requests.begin(), completed_requests.begin() + count);
+    for (int i = 0; i < count; ++i) {
+        const RequestKind kind = static_cast <RequestKind>(completed_requests[i] / (rank_size - 1));
+        const int worker_rank = completed_requests[i] % (rank_size - 1) + 1;
+        node_t &node = nodes[worker_rank];
+        switch (kind) {
+        case send_status_request:
+            node.send_status_s = RequestStatus::active;
+            if (node.state == NodeState::sending_status)
+                node.state = NodeState::sending_status_complete;
+            break;
+        case send_data_request:
+            data_sent(serializer, worker_rank);
+            break;
+        case recv_status_request:
+            node.recv_status_s = RequestStatus::active;
+            node.unpack();
+            if (node.status_buffer == WorkerStatus::unknown && active_workerQ(worker_rank))
+                __logger__(LogType::info, "Worker: ", worker_rank, " has come to life");
+            last_ping = now();
+            node.last_ping = last_ping;
+            respond_worker(serializer, worker_rank);
+            break;
+        default:
+            break;
         }
     }
-    if (node.state == NodeState::sending_data)
-        send_data(serializer, worker_rank, timeout, sleep);
-    if (node.state == NodeState::sending_data_complete) {
-        node.state = NodeState::ready;
-        node.active_cycle = false;
-    }
+    return count;
 }
 
 template <typename TaskQueue, ServerMode mode>
@@ -314,21 +474,47 @@ void MasterProcess <TaskQueue, mode>::move_queue(TaskQueue &queue) {
     queue = std::move(__queue__);
 }
 
+template <typename TaskQueue, ServerMode mode>
+void MasterProcess <TaskQueue, mode>::set_batch_size(size_t max_batch) {
+    this->max_batch = std::max(max_batch, size_t(1));
+}
+
+template <typename TaskQueue, ServerMode mode>
+void MasterProcess <TaskQueue, mode>::set_batch_observer(const batch_observer_t &observer) {
+    batch_observer = observer;
+}
+
+template <typename TaskQueue, ServerMode mode>
+void MasterProcess <TaskQueue, mode>::set_result_observer(const result_observer_t &observer) {
+    result_observer = observer;
+}
+
+template <typename TaskQueue, ServerMode mode>
+void MasterProcess <TaskQueue, mode>::set_reply_bound(const bound_t &bound) {
+    reply_bound = bound;
+}
+
+template <typename TaskQueue, ServerMode mode>
+void MasterProcess <TaskQueue, mode>::set_journal(TaskJournal *journal) {
+    this->journal = journal;
+}
+
 template <typename TaskQueue, ServerMode mode>
 template <typename Serializer>
 inline int MasterProcess <TaskQueue, mode>::run(Serializer &serializer,
         const duration &report_interval) {
-    MPI_Status mpi_status;
     time_point last_ping;
     time_point last_report;
     bool report = true;
     bool ntimed_out = false;
+    duration idle_sleep = duration(0);
     __logger__(LogType::info, "Server has started");
     init_channels();
     last_ping = now();
     last_report = now();
-    while ((ntimed_out = (elapsed(now(), last_ping) <= master_timeout)) && !__queue__.finished()) {
-        time_point start = now();
+    // The workers are answered until all of them were told to stop, even when there was nothing to do
+    while ((ntimed_out = (elapsed(now(), last_ping) <= master_timeout))
+            && !(__queue__.finished() && workers_stopped())) {
         if (report) {
             std::tuple <size_t, size_t, size_t> queue_status = __queue__.status();
             __logger__(LogType::info, "Active workers: ", active_workers(), ", Completed tasks: ",
@@ -337,29 +523,22 @@ inline int MasterProcess <TaskQueue, mode>::run(Serializer &serializer,
             report = false;
             last_report = now();
         }
-        auto [err, incomingQ] = iprobe(__logger__, MPI_ANY_SOURCE, node_t::w2m_status_tag, &mpi_status,
-                communicator);
-        if (incomingQ && (err == 0)) {
-            mpi_error <true>(__logger__, mpi_status.MPI_ERROR);
-            int worker_rank = mpi_status.MPI_SOURCE;
-            if (nodes[worker_rank].active_cycle == false) {
-                nodes[worker_rank].active_cycle = true;
-                full_cycle(serializer, worker_rank, cycle_timeout, medium_sleep);
-                last_ping = now();
-                nodes[worker_rank].last_ping = last_ping;
-            }
-        } else {
-            for (size_t worker_rank = 1; worker_rank < nodes.size(); ++worker_rank)
-                if (nodes[worker_rank].active_cycle == true)
-                    full_cycle(serializer, worker_rank, small_cycle_timeout, small_sleep);
-            last_ping += now() - start;
-            std::this_thread::sleep_for(medium_sleep);
+        if (progress(serializer, last_ping) > 0)
+            idle_sleep = duration(0);
+        else { // back off while nothing happens, up to max_idle_sleep
+            idle_sleep = std::clamp(idle_sleep * 2, duration(min_idle_sleep), duration(max_idle_sleep));
+            std::this_thread::sleep_for(idle_sleep);
         }
         report = report || (elapsed(now(), last_report) >= report_interval);
+        if (journal)
+            journal->sync();
     }
     if (!ntimed_out) {
         __logger__(LogType::info, "Communication channel has timed out, shutting down");
     }
+    close_channels(ntimed_out);
+    if (journal)
+        journal->sync(true);
     std::tuple <size_t, size_t, size_t> queue_status = __queue__.status();
     __logger__(LogType::info, "Peak number of workers: ", rank_size - 1, ", Completed tasks: ",
             std::get <0>(queue_status), ", Scheduled tasks: ", std::get <1>(queue_status),
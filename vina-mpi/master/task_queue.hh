@@ -9,23 +9,37 @@
 #ifndef __TASK_QUEUE_HH__
 #define __TASK_QUEUE_HH__
 
-#include <map>
+#include <algorithm>
 #include <deque>
+#include <functional>
+#include <map>
+#include <unordered_map>
 #include <unordered_set>
+#include <vector>
 #include "../definitions.hh"
 
 namespace MPIBatch {
 template <typename data_t>
 class task_queue {
 public:
+    using task_t = data_t;
     using task_info_t = std::pair <data_t*, int64_t>;
+    using priority_t = std::function <double(const data_t&)>;
+    using source_t = std::function <bool(data_t&)>; // sets the next task, false once there are no more
 private:
     std::map <int64_t, data_t> __data__;
-    std::deque <int64_t> __queue__;
+    std::deque <int64_t> __queue__; // by decreasing priority when there is one, else FIFO
+    std::unordered_map <int64_t, double> __priorities__;
+    priority_t __priority__;
+    source_t __source__;
+    size_t __window__ = 0;
     std::unordered_set <int64_t> __scheduled_queue__;
     std::deque <int64_t> __completed_queue__;
     int64_t __next_task_id__ = 0;
     void clear();
+    void sort();
+    void enqueue(int64_t task_id);
+    void fill();
 public:
     task_queue();
     ~task_queue();
@@ -43,8 +57,14 @@ public:
     void insert(const Iterator &begin, const Iterator &end);
     void push(data_t &&data);
     std::pair <data_t*, int64_t> pop();
+    std::vector <std::pair <data_t*, int64_t>> pop(size_t count);
     void requeue(std::pair <data_t*, int64_t> &task);
     std::tuple <size_t, size_t, size_t> status() const;
+
+    void set_priority(const priority_t &priority); // the queued tasks are then handed out highest priority first
+    void reprioritize(); // recomputes the priority of the queued tasks and reorders them
+    // Takes the tasks from source as the queue drains, keeping up to window of them queued
+    void set_source(const source_t &source, size_t window);
 };
 
 template <typename data_t>
@@ -59,14 +79,17 @@ inline task_queue <data_t>::~task_queue() {
 
 template <typename data_t>
 inline task_queue <data_t>::task_queue(const task_queue &queue) :
-        __data__(queue.__data__), __queue__(queue.__queue__), __scheduled_queue__(
-                queue.__scheduled_queue__), __completed_queue__(queue.__completed_queue__) {
+        __data__(queue.__data__), __queue__(queue.__queue__), __priorities__(queue.__priorities__), __priority__(
+                queue.__priority__), __source__(queue.__source__), __window__(queue.__window__), __scheduled_queue__(queue.__scheduled_queue__), __completed_queue__(
+                queue.__completed_queue__) {
     __next_task_id__ = queue.__next_task_id__;
 }
 
 template <typename data_t>
 inline task_queue <data_t>::task_queue(task_queue &&queue) :
-        __data__(std::move(queue.__data__)), __queue__(std::move(queue.__queue__)), __scheduled_queue__(
+        __data__(std::move(queue.__data__)), __queue__(std::move(queue.__queue__)), __priorities__(
+                std::move(queue.__priorities__)), __priority__(std::move(queue.__priority__)), __source__(
+                std::move(queue.__source__)), __window__(queue.__window__), __scheduled_queue__(
                 std::move(queue.__scheduled_queue__)), __completed_queue__(
                 std::move(queue.__completed_queue__)) {
     __next_task_id__ = queue.__next_task_id__;
@@ -77,6 +100,10 @@ template <typename data_t>
 inline task_queue <data_t>& task_queue <data_t>::operator =(const task_queue &queue) {
     __data__ = queue.__data__;
     __queue__ = queue.__queue__;
+    __priorities__ = queue.__priorities__;
+    __priority__ = queue.__priority__;
+    __source__ = queue.__source__;
+    __window__ = queue.__window__;
     __scheduled_queue__ = queue.__scheduled_queue__;
     __completed_queue__ = queue.__completed_queue__;
     __next_task_id__ = queue.__next_task_id__;
@@ -87,6 +114,10 @@ template <typename data_t>
 inline task_queue <data_t>& task_queue <data_t>::operator =(task_queue &&queue) {
     __data__ = std::move(queue.__data__);
     __queue__ = std::move(queue.__queue__);
+    __priorities__ = std::move(queue.__priorities__);
+    __priority__ = std::move(queue.__priority__);
+    __source__ = std::move(queue.__source__);
+    __window__ = queue.__window__;
     __scheduled_queue__ = std::move(queue.__scheduled_queue__);
     __completed_queue__ = std::move(queue.__completed_queue__);
     __next_task_id__ = queue.__next_task_id__;
@@ -98,6 +129,8 @@ template <typename data_t>
 inline void task_queue <data_t>::clear() {
     __next_task_id__ = invalid_task_id;
     __queue__.clear();
+    __priorities__.clear();
+    __source__ = source_t();
     __scheduled_queue__.clear();
     __completed_queue__.clear();
     __data__.clear();
@@ -115,6 +148,7 @@ inline void task_queue <data_t>::completed(int64_t task_id) {
         if (it != __scheduled_queue__.end()) {
             __completed_queue__.push_back(*it);
             __scheduled_queue__.erase(it);
+            __data__.erase(task_id);
         }
     }
 }
@@ -135,14 +169,17 @@ inline void task_queue <data_t>::insert(const Iterator &begin, const Iterator &e
     for (auto it = begin; it != end; ++it) {
         __data__[__next_task_id__] = *it;
         __queue__.push_back(__next_task_id__);
+        if (__priority__)
+            __priorities__[__next_task_id__] = __priority__(*it);
         ++__next_task_id__;
     }
+    sort();
 }
 
 template <typename data_t>
 inline void task_queue <data_t>::push(data_t &&data) {
     __data__[__next_task_id__] = std::move(data);
-    __queue__.push_back(__next_task_id__);
+    enqueue(__next_task_id__);
     ++__next_task_id__;
 }
 
@@ -152,18 +189,31 @@ inline std::pair <data_t*, int64_t> task_queue <data_t>::pop() {
     if (!empty()) {
         result.second = __queue__.front();
         __queue__.pop_front();
+        __priorities__.erase(result.second);
         result.first = &(__data__.at(result.second));
         __scheduled_queue__.insert(result.second);
+        fill();
     }
     return result;
 }
 
+template <typename data_t>
+inline std::vector <std::pair <data_t*, int64_t>> task_queue <data_t>::pop(size_t count) {
+    std::vector <std::pair <data_t*, int64_t>> result;
+    while (result.size() < count && !empty())
+        result.push_back(pop());
+    return result;
+}
+
 template <typename data_t>
 inline void task_queue <data_t>::requeue(std::pair <data_t*, int64_t> &task) {
     auto it = __scheduled_queue__.find(task.second);
     if (it != __scheduled_queue__.end() && (task.second >= 0)) {
-        __queue__.push_front(task.second);
         __scheduled_queue__.erase(it);
+        if (__priority__)
+            enqueue(task.second);
+        else
+            __queue__.push_front(task.second);
     }
 }
 
@@ -173,6 +223,73 @@ inline std::tuple <size_t, size_t, size_t> task_queue <data_t>::status() const {
             __completed_queue__.size(), __scheduled_queue__.size(), __queue__.size());
     return result;
 }
+
+template <typename data_t>
+inline void task_queue <data_t>::set_priority(const priority_t &priority) {
+    __priority__ = priority;
+    reprioritize();
+}
+
+template <typename data_t>
+inline void task_queue <data_t>::reprioritize() {
+    __priorities__.clear();
+    if (__priority__)
+        for (int64_t task_id : __queue__)
+            __priorities__[task_id] = __priority__(__data__.at(task_id));
+    sort();
+}
+
+template <typename data_t>
+inline void task_queue <data_t>::set_source(const source_t &source, size_t window) {
+    __source__ = source;
+    __window__ = std::max(window, size_t(1));
+    fill();
+}
+
+// Refills the queue once it is down to half the window, so that a priority sorts the new tasks in bulk
+template <typename data_t>
+inline void task_queue <data_t>::fill() {
+    if (!__source__ || __queue__.size() > __window__ / 2)
+        return;
+    data_t data;
+    while (__queue__.size() < __window__) {
+        if (!__source__(data)) {
+            __source__ = source_t();
+            break;
+        }
+        __data__[__next_task_id__] = std::move(data);
+        __queue__.push_back(__next_task_id__);
+        if (__priority__)
+            __priorities__[__next_task_id__] = __priority__(__data__.at(__next_task_id__));
+        ++__next_task_id__;
+    }
+    sort();
+}
+
+// Behind the tasks of the same or higher priority
+template <typename data_t>
+inline void task_queue <data_t>::enqueue(int64_t task_id) {
+    if (!__priority__) {
+        __queue__.push_back(task_id);
+        return;
+    }
+    double priority = __priority__(__data__.at(task_id));
+    __priorities__[task_id] = priority;
+    auto it = std::upper_bound(__queue__.begin(), __queue__.end(), priority, [this](double p, int64_t y) {
+        return p > __priorities__.at(y);
+    });
+    __queue__.insert(it, task_id);
+}
+
+// Stable, so that equal priorities keep their FIFO order
+template <typename data_t>
+inline void task_queue <data_t>::sort() {
+    if (!__priority__)
+        return;
+    std::stable_sort(__queue__.begin(), __queue__.end(), [this](int64_t x, int64_t y) {
+        return __priorities__.at(x) > __priorities__.at(y);
+    });
+}
 }
 
 #endif
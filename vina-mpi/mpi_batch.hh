@@ -13,14 +13,26 @@
 #include "util/util.hh"
 #include "mpi_batch.hh"
 #include "io/io.hh"
+#include "io/async_writer.hh"
 #include "io/logger.hh"
+#include "io/ligand_library.hh"
+#include "io/ligand_prefetcher.hh"
 #include "serializers/string_serializer.hh"
+#include "serializers/payload_serializer.hh"
+#include "serializers/result_serializer.hh"
 #include "master/task_queue.hh"
+#include "master/dense_task_queue.hh"
+#include "master/ligand_cost.hh"
+#include "master/journal.hh"
+#include "master/ligand_source.hh"
+#include "master/ligand_ranking.hh"
 #include "node.hh"
 #include "worker/worker-process.hh"
 #include "arguments/arguments.hh"
 #include "master/master_process.hh"
 #include "worker/task_container.hh"
+#include "worker/shared_grids.hh"
+#include "worker/shard_writer.hh"
 #include "vina_util.hh"
 
 #endif
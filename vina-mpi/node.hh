@@ -9,6 +9,9 @@
 #ifndef __NODE_HH__
 #define __NODE_HH__
 
+#include <array>
+#include <deque>
+#include <vector>
 #include <mpi.h>
 
 #include "definitions.hh"
@@ -24,6 +27,17 @@ public:
     static constexpr int send_data_tag = static_cast <int>(MessageTags::send_data);
     static constexpr int recv_data_tag = static_cast <int>(MessageTags::recv_data);
     static constexpr int kill_tag = static_cast <int>(MessageTags::kill);
+    static constexpr int results_tag = static_cast <int>(MessageTags::results);
+    // A status message holds the status, the worker slot it refers to and a bound the master attaches
+    // to its replies
+    static constexpr int status_count = 3;
+
+    // A batch of tasks sent in one message, to one slot of the worker
+    struct batch_t {
+        std::vector <task_info_t> tasks = std::vector <task_info_t>();
+        time_point dispatch_time = now();
+        int slot = 0;
+    };
 
     // Class members
     int rank = -1;
@@ -32,6 +46,12 @@ public:
     NodeState state = NodeState::unknown;
     WorkerStatus status = WorkerStatus::unknown;
     WorkerStatus status_buffer = WorkerStatus::unknown;
+    int slot = 0;
+    int slot_buffer = 0;
+    int bound = no_bound;
+    int bound_buffer = no_bound;
+    std::array <int, status_count> message = std::array <int, status_count>(); // received
+    std::array <int, status_count> message_buffer = std::array <int, status_count>(); // sent
     MPI_Request send_status = MPI_REQUEST_NULL;
     MPI_Request recv_status = MPI_REQUEST_NULL;
     MPI_Request send_data = MPI_REQUEST_NULL;
@@ -44,7 +64,7 @@ public:
 
     time_point last_ping = now();
 
-    task_info_t task_info = task_info_t(nullptr, invalid_task_id);
+    std::deque <batch_t> batches = std::deque <batch_t>(); // the batches the node holds, oldest first
 
     int64_t serialization_id = invalid_task_id;
 
@@ -58,12 +78,13 @@ public:
     Node& operator=(Node &&node);
 
     void clear();
-    void clear_task_info();
+    void clear_tasks();
     void* status_addr();
     void* status_buffer_addr();
 
     bool syncQ();
     void sync();
+    void unpack();
 };
 
 template <typename task_info_t>
@@ -81,6 +102,12 @@ inline Node <task_info_t>::Node(Node &&node) {
     state = node.state;
     status = node.status;
     status_buffer = node.status_buffer;
+    slot = node.slot;
+    slot_buffer = node.slot_buffer;
+    bound = node.bound;
+    bound_buffer = node.bound_buffer;
+    message = node.message;
+    message_buffer = node.message_buffer;
     send_status = node.send_status;
     recv_status = node.recv_status;
     send_data = node.send_data;
@@ -90,7 +117,7 @@ inline Node <task_info_t>::Node(Node &&node) {
     send_data_s = node.send_data_s;
     recv_data_s = node.recv_data_s;
     last_ping = node.last_ping;
-    task_info = node.task_info;
+    batches = std::move(node.batches);
     active_cycle = node.active_cycle;
     scheduled = node.scheduled;
     node.clear();
@@ -102,6 +129,12 @@ inline Node <task_info_t>& Node <task_info_t>::operator =(Node &&node) {
     state = node.state;
     status = node.status;
     status_buffer = node.status_buffer;
+    slot = node.slot;
+    slot_buffer = node.slot_buffer;
+    bound = node.bound;
+    bound_buffer = node.bound_buffer;
+    message = node.message;
+    message_buffer = node.message_buffer;
     send_status = node.send_status;
     recv_status = node.recv_status;
     send_data = node.send_data;
@@ -111,7 +144,7 @@ inline Node <task_info_t>& Node <task_info_t>::operator =(Node &&node) {
     send_data_s = node.send_data_s;
     recv_data_s = node.recv_data_s;
     last_ping = node.last_ping;
-    task_info = node.task_info;
+    batches = std::move(node.batches);
     active_cycle = node.active_cycle;
     scheduled = node.scheduled;
     node.clear();
@@ -126,6 +159,10 @@ inline void Node <task_info_t>::clear() {
     state = NodeState::terminated;
     status = WorkerStatus::unknown;
     status_buffer = WorkerStatus::unknown;
+    slot = 0;
+    slot_buffer = 0;
+    bound = no_bound;
+    bound_buffer = no_bound;
     send_status = MPI_REQUEST_NULL;
     recv_status = MPI_REQUEST_NULL;
     send_data = MPI_REQUEST_NULL;
@@ -135,32 +172,43 @@ inline void Node <task_info_t>::clear() {
     send_data_s = RequestStatus::null;
     recv_data_s = RequestStatus::null;
     serialization_id = invalid_task_id;
-    clear_task_info();
+    clear_tasks();
 }
 
 template <typename task_info_t>
-inline void Node <task_info_t>::clear_task_info() {
-    task_info = task_info_t(nullptr, invalid_task_id);
+inline void Node <task_info_t>::clear_tasks() {
+    batches.clear();
 }
 
 template <typename task_info_t>
 inline void* Node <task_info_t>::status_addr() {
-    return reinterpret_cast <void*>(&status);
+    return reinterpret_cast <void*>(message.data());
 }
 
 template <typename task_info_t>
 inline void* Node <task_info_t>::status_buffer_addr() {
-    return reinterpret_cast <void*>(&status_buffer);
+    return reinterpret_cast <void*>(message_buffer.data());
 }
 
 template <typename task_info_t>
 inline bool Node <task_info_t>::syncQ() {
-    return status == status_buffer;
+    return status == status_buffer && slot == slot_buffer && bound == bound_buffer;
 }
 
 template <typename task_info_t>
 inline void Node <task_info_t>::sync() {
     status_buffer = status;
+    slot_buffer = slot;
+    bound_buffer = bound;
+    message_buffer = { static_cast <int>(status_buffer), slot_buffer, bound_buffer };
+}
+
+// Reads the status message that was just received
+template <typename task_info_t>
+inline void Node <task_info_t>::unpack() {
+    status = static_cast <WorkerStatus>(message[0]);
+    slot = message[1];
+    bound = message[2];
 }
 
 }
@@ -0,0 +1,38 @@
+//============================================================================
+// Name        : payload_serializer.cc
+// Author      : Fabian Mora
+// Version     : 1.0
+// License     : MIT license
+// Description :
+//============================================================================
+
+#include "payload_serializer.hh"
+#include "../io/ligand_library.hh"
+
+namespace MPIBatch {
+void PayloadSerializer::set_prefetcher(LigandPrefetcher *prefetcher) {
+    __prefetcher__ = prefetcher;
+}
+
+std::tuple <void*, int, MPI_Datatype, int64_t> PayloadSerializer::operator()(
+        const std::vector <std::string> &batch) {
+    std::vector <std::string> tasks;
+    tasks.reserve(batch.size());
+    std::string contents;
+    for (const std::string &ligand : batch) {
+        bool read = (__prefetcher__ && __prefetcher__->take(ligand, contents)) || read_ligand(ligand, contents);
+        if (read && contents.find('\0') == std::string::npos)
+            tasks.push_back(ligand + '\n' + contents);
+        else
+            tasks.push_back(ligand);
+    }
+    return serialize(tasks);
+}
+
+std::pair <std::string, std::string> PayloadSerializer::split(const std::string &task) {
+    size_t end = task.find('\n');
+    if (end == std::string::npos)
+        return std::pair <std::string, std::string>(task, std::string());
+    return std::pair <std::string, std::string>(task.substr(0, end), task.substr(end + 1));
+}
+}
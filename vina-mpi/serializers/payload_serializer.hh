@@ -0,0 +1,35 @@
+//============================================================================
+// Name        : payload_serializer.hh
+// Author      : Fabian Mora
+// Version     : 1.0
+// License     : MIT license
+// Description :
+//============================================================================
+
+#ifndef __PAYLOAD_SERIALIZER_HH__
+#define __PAYLOAD_SERIALIZER_HH__
+
+#include <string>
+#include <utility>
+#include <vector>
+#include "string_serializer.hh"
+#include "../io/ligand_prefetcher.hh"
+
+namespace MPIBatch {
+// Sends every ligand as its path, a newline and the contents of the file, so that the workers don't
+// touch the file system for their input. A ligand the master couldn't read goes as its path alone, the
+// worker then reads the file itself. The contents come from the prefetcher when it read them already.
+class PayloadSerializer: public StringSerializer {
+private:
+    LigandPrefetcher *__prefetcher__ = nullptr;
+public:
+    using StringSerializer::StringSerializer;
+    using StringSerializer::operator();
+
+    void set_prefetcher(LigandPrefetcher *prefetcher); // has to outlive the serializer
+    std::tuple <void*, int, MPI_Datatype, int64_t> operator()(const std::vector <std::string> &batch);
+    // The ligand path and its contents, empty when the task only holds the path
+    static std::pair <std::string, std::string> split(const std::string &task);
+};
+}
+#endif
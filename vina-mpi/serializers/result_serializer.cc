@@ -0,0 +1,58 @@
+//============================================================================
+// Name        : result_serializer.cc
+// Author      : Fabian Mora
+// Version     : 1.0
+// License     : MIT license
+// Description :
+//============================================================================
+
+#include <cstring>
+#include "result_serializer.hh"
+
+namespace MPIBatch {
+namespace {
+// Every result is its header followed by payload_size bytes of payload
+struct result_header_t {
+    double score;
+    double seconds;
+    int32_t modes;
+    int32_t status;
+    uint64_t payload_size;
+};
+}
+
+std::string ResultSerializer::pack(const std::vector <task_result_t> &results) {
+    size_t size = 0;
+    for (const task_result_t &result : results)
+        size += sizeof(result_header_t) + result.payload.size();
+    std::string message;
+    message.reserve(size);
+    for (const task_result_t &result : results) {
+        result_header_t header = { result.score, result.seconds, result.modes, result.status, result.payload.size() };
+        message.append(reinterpret_cast <const char*>(&header), sizeof(header));
+        message += result.payload;
+    }
+    return message;
+}
+
+std::vector <task_result_t> ResultSerializer::unpack(const std::string &message) {
+    std::vector <task_result_t> results;
+    size_t position = 0;
+    while (position + sizeof(result_header_t) <= message.size()) {
+        result_header_t header;
+        std::memcpy(&header, message.data() + position, sizeof(header));
+        position += sizeof(header);
+        if (header.payload_size > message.size() - position)
+            break;
+        task_result_t result;
+        result.score = header.score;
+        result.seconds = header.seconds;
+        result.modes = header.modes;
+        result.status = header.status;
+        result.payload = message.substr(position, header.payload_size);
+        position += header.payload_size;
+        results.push_back(std::move(result));
+    }
+    return results;
+}
+}
@@ -0,0 +1,34 @@
+//============================================================================
+// Name        : result_serializer.hh
+// Author      : Fabian Mora
+// Version     : 1.0
+// License     : MIT license
+// Description :
+//============================================================================
+
+#ifndef __RESULT_SERIALIZER_HH__
+#define __RESULT_SERIALIZER_HH__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace MPIBatch {
+// What a worker reports for every task of a finished batch, in the order of the batch
+struct task_result_t {
+    double score = 0; // the best affinity, kcal/mol
+    double seconds = 0; // the docking time
+    int32_t modes = 0;
+    int32_t status = 0; // 0 when the task succeeded
+    std::string payload = std::string(); // the output models, when the master asked for them
+};
+
+// Packs the results of a batch into one message of bytes, so the workers and the master have to share
+// the byte order and the floating point format
+class ResultSerializer {
+public:
+    static std::string pack(const std::vector <task_result_t> &results);
+    static std::vector <task_result_t> unpack(const std::string &message);
+};
+}
+#endif
@@ -41,6 +41,11 @@ std::tuple <void*, int, MPI_Datatype, int64_t> StringSerializer::operator()(std:
     return serialize(data);
 }
 
+std::tuple <void*, int, MPI_Datatype, int64_t> StringSerializer::operator()(
+        const std::vector <std::string> &batch) {
+    return serialize(batch);
+}
+
 void StringSerializer::free(const std::tuple <void*, int, MPI_Datatype, int64_t> &data) {
     auto it = __data__->find(std::get <3>(data));
     if (it != __data__->end()) {
@@ -60,16 +65,31 @@ MPI_Datatype StringSerializer::mpi_type() const {
 }
 
 std::tuple <void*, int, MPI_Datatype, int64_t> StringSerializer::serialize(std::string data) {
-    int64_t id = __next_slot__;
+    int64_t id = __next_slot__++; // a slot per message in flight
     (*__data__)[id] = data;
     void *ptr = data.empty() ? nullptr : reinterpret_cast <void*>((*__data__)[id].data());
     return std::tuple <void*, int, MPI_Datatype, int64_t>(ptr, data.size(), mpi_data_type, id);
 }
 
-std::string StringSerializer::deserialize(std::vector <data_t> &buffer) {
-    std::string result = std::string(buffer.size(), ' ');
-    for (size_t i = 0; i < buffer.size(); ++i)
-        result[i] = buffer[i];
+std::tuple <void*, int, MPI_Datatype, int64_t> StringSerializer::serialize(
+        const std::vector <std::string> &batch) {
+    std::string data;
+    for (size_t i = 0; i < batch.size(); ++i) {
+        if (i > 0)
+            data.push_back('\0');
+        data += batch[i];
+    }
+    return serialize(data);
+}
+
+std::vector <std::string> StringSerializer::deserialize(std::vector <data_t> &buffer) {
+    std::vector <std::string> result(1);
+    for (size_t i = 0; i < buffer.size(); ++i) {
+        if (buffer[i] == '\0')
+            result.push_back(std::string());
+        else
+            result.back().push_back(buffer[i]);
+    }
     return result;
 }
 }
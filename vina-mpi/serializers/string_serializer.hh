@@ -19,7 +19,7 @@ namespace MPIBatch {
 class StringSerializer {
 public:
     using data_t = typename std::string::value_type;
-    static constexpr MPI_Datatype mpi_data_type = MPI_CHAR;
+    static inline const MPI_Datatype mpi_data_type = MPI_CHAR;
 private:
     std::unordered_map<int64_t, std::string>* __data__ = nullptr;
     int64_t __next_slot__ = 0;
@@ -30,12 +30,15 @@ public:
     StringSerializer& operator=(StringSerializer &&other);
 
     std::tuple <void*, int, MPI_Datatype, int64_t> operator()(std::string data);
+    std::tuple <void*, int, MPI_Datatype, int64_t> operator()(const std::vector <std::string> &batch);
 
     void free(const std::tuple <void*, int, MPI_Datatype, int64_t>& data);
     void free(int64_t id);
     MPI_Datatype mpi_type() const;
     std::tuple <void*, int, MPI_Datatype, int64_t> serialize(std::string data);
-    std::string deserialize(std::vector <data_t> &buffer);
+    // A batch is packed as its strings separated by '\0', a batch of one is the string itself
+    std::tuple <void*, int, MPI_Datatype, int64_t> serialize(const std::vector <std::string> &batch);
+    std::vector <std::string> deserialize(std::vector <data_t> &buffer);
 };
 
 }
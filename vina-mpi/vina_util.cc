@@ -6,12 +6,11 @@
 // Description :
 //============================================================================
 
-#include <algorithm>
-#include <cctype>
 #include <filesystem>
-#include <regex>
+#include <fstream>
 #include <string>
 #include "vina_util.hh"
+#include "io/ligand_library.hh"
 
 namespace MPIBatch {
 void init_dirs(options_t &options) {
@@ -33,29 +32,24 @@ void init_dirs(options_t &options) {
     }
 }
 
-std::vector <std::string> pdbqt_files(options_t &options) {
-    namespace fs = std::filesystem;
-    std::vector <std::string> files;
-    if (options.vm.count("vina-ligand-dir") > 0) {
-        fs::path path = options.vm["vina-ligand-dir"].as <std::string>();
-        if (fs::is_directory(path)) {
-            for (auto &p : fs::directory_iterator(path)) {
-                std::string ext = p.path().extension().string();
-                std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) {
-                    return std::tolower(c);
-                });
-                if (ext == ".pdbqt")
-                    files.push_back(p.path().string());
-            }
-        }
-    }
-    return files;
+std::string vina_out_path(options_t &options, const std::string &ligand) {
+    std::filesystem::path out_path = std::filesystem::path(options.vm["vina-out-dir"].as <std::string>());
+    std::string suffix;
+    if (options.vm.count("vina-out-suffix") > 0)
+        suffix = options.vm["vina-out-suffix"].as <std::string>();
+    out_path /= ligand_name(ligand) + suffix + ".pdbqt";
+    return out_path.string();
 }
 
-std::vector <std::string> init_vina_files(options_t &options) {
-    std::vector <std::string> files = pdbqt_files(options);
-    if (!files.empty())
-        init_dirs(options);
-    return files;
+// Vina writes the models at the end of the docking, an output is complete when its last record closes a
+// model
+bool complete_pdbqt(const std::string &path) {
+    std::ifstream file(path);
+    std::string line;
+    std::string last;
+    while (std::getline(file, line))
+        if (line.find_first_not_of(" \t\r") != std::string::npos)
+            last = line;
+    return last.compare(0, 6, "ENDMDL") == 0;
 }
 }
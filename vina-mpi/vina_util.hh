@@ -9,12 +9,12 @@
 #ifndef __VINA_UTIL_HH__
 #define __VINA_UTIL_HH__
 
-#include <vector>
+#include <string>
 #include "arguments/arguments.hh"
 
 namespace MPIBatch {
 void init_dirs(options_t &options);
-std::vector <std::string> pdbqt_files(options_t &options);
-std::vector <std::string> init_vina_files(options_t &options);
+std::string vina_out_path(options_t &options, const std::string &ligand);
+bool complete_pdbqt(const std::string &path);
 }
 #endif
@@ -0,0 +1,163 @@
+//============================================================================
+// Name        : shard_writer.cc
+// Author      : Fabian Mora
+// Version     : 1.0
+// License     : MIT license
+// Description :
+//============================================================================
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include "shard_writer.hh"
+
+namespace MPIBatch {
+namespace {
+const std::string shard_models_extension = ".shard.pdbqt";
+const std::string shard_index_extension = ".shard.idx";
+
+bool ends_with(const std::string &str, const std::string &suffix) {
+    return str.size() >= suffix.size() && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+int open_append(const std::string &path) {
+    int fd = ::open(path.c_str(), O_WRONLY | O_APPEND | O_CREAT, 0644);
+    if (fd < 0)
+        throw(std::runtime_error("Couldn't open the shard " + path + ": " + std::strerror(errno)));
+    return fd;
+}
+
+// The shard index files of dir
+std::vector <std::filesystem::path> shard_indexes(const std::string &dir) {
+    std::vector <std::filesystem::path> indexes;
+    std::error_code error;
+    for (auto it = std::filesystem::directory_iterator(dir, error); !error && it != std::filesystem::directory_iterator();
+            it.increment(error))
+        if (ends_with(it->path().filename().string(), shard_index_extension))
+            indexes.push_back(it->path());
+    std::sort(indexes.begin(), indexes.end());
+    return indexes;
+}
+}
+
+ShardWriter::~ShardWriter() {
+    close();
+}
+
+void ShardWriter::open(const std::string &dir, const std::string &name) {
+    close();
+    // The workers may get here before the master creates the output directory
+    std::error_code error;
+    std::filesystem::create_directories(dir, error);
+    std::filesystem::path path = std::filesystem::path(dir) / name;
+    __models_path__ = path.string() + shard_models_extension;
+    __models_fd__ = open_append(__models_path__);
+    __index_fd__ = open_append(path.string() + shard_index_extension);
+    off_t size = ::lseek(__models_fd__, 0, SEEK_END);
+    __offset__ = (size > 0) ? static_cast <uint64_t>(size) : 0;
+}
+
+void ShardWriter::set_writer(AsyncWriter *writer) {
+    __writer__ = writer;
+}
+
+void ShardWriter::close() {
+    if (__models_fd__ < 0)
+        return;
+    flush();
+    if (__writer__)
+        __writer__->drain();
+    ::close(__models_fd__);
+    ::close(__index_fd__);
+    __models_fd__ = -1;
+    __index_fd__ = -1;
+}
+
+bool ShardWriter::is_open() const {
+    return __models_fd__ >= 0;
+}
+
+void ShardWriter::write(int fd, std::string &buffer) {
+    if (__writer__)
+        __writer__->append(fd, std::move(buffer));
+    else
+        AsyncWriter::write_fd(fd, buffer);
+    buffer.clear();
+}
+
+void ShardWriter::append(const std::string &ligand, const std::string &models, double best_energy) {
+    std::lock_guard <std::mutex> lock(__mutex__);
+    std::ostringstream line;
+    line << ligand << '\t' << __offset__ << '\t' << models.size() << '\t' << best_energy << '\n';
+    __models__ += models;
+    __index__ += line.str();
+    __offset__ += models.size();
+    if (__models__.size() >= shard_flush_size) {
+        // The models first, an index line never points past the end of the shard
+        write(__models_fd__, __models__);
+        write(__index_fd__, __index__);
+    }
+}
+
+void ShardWriter::flush() {
+    std::lock_guard <std::mutex> lock(__mutex__);
+    if (__models_fd__ < 0)
+        return;
+    write(__models_fd__, __models__);
+    write(__index_fd__, __index__);
+}
+
+std::unordered_set <std::string> shard_ligands(const std::string &dir) {
+    std::unordered_set <std::string> ligands;
+    for (const std::filesystem::path &index_path : shard_indexes(dir)) {
+        std::ifstream index(index_path);
+        std::string line;
+        while (std::getline(index, line))
+            ligands.insert(line.substr(0, line.find('\t')));
+    }
+    return ligands;
+}
+
+size_t merge_shard_indexes(const std::string &dir, const std::string &table_path) {
+    struct row_t {
+        double best_energy;
+        std::string line;
+    };
+    std::vector <row_t> rows;
+    for (const std::filesystem::path &index_path : shard_indexes(dir)) {
+        std::string shard = index_path.filename().string();
+        shard = shard.substr(0, shard.size() - shard_index_extension.size()) + shard_models_extension;
+        std::ifstream index(index_path);
+        std::string line;
+        while (std::getline(index, line)) {
+            std::istringstream fields(line);
+            std::string ligand;
+            uint64_t offset = 0;
+            uint64_t length = 0;
+            double best_energy = 0;
+            std::getline(fields, ligand, '\t');
+            fields >> offset >> length >> best_energy;
+            if (!fields)
+                continue;
+            std::ostringstream row;
+            row << ligand << '\t' << best_energy << '\t' << shard << '\t' << offset << '\t' << length << '\n';
+            rows.push_back( { best_energy, row.str() });
+        }
+    }
+    std::stable_sort(rows.begin(), rows.end(), [](const row_t &x, const row_t &y) {
+        return x.best_energy < y.best_energy;
+    });
+    std::ofstream table(table_path);
+    table << "ligand\taffinity\tshard\toffset\tlength\n";
+    for (const row_t &row : rows)
+        table << row.line;
+    return rows.size();
+}
+}
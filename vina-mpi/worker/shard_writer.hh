@@ -0,0 +1,59 @@
+//============================================================================
+// Name        : shard_writer.hh
+// Author      : Fabian Mora
+// Version     : 1.0
+// License     : MIT license
+// Description :
+//============================================================================
+
+#ifndef __SHARD_WRITER_HH__
+#define __SHARD_WRITER_HH__
+
+#include <mutex>
+#include <string>
+#include <unordered_set>
+
+#include "../definitions.hh"
+#include "../io/async_writer.hh"
+
+namespace MPIBatch {
+// Appends the models of every ligand a worker docks to one shard, <name>.shard.pdbqt, instead of a file
+// per ligand, with a line "<ligand>\t<offset>\t<length>\t<best affinity>" per ligand in <name>.shard.idx.
+// Both are buffered and written in blocks of shard_flush_size, so the models of a worker that is killed
+// before flush or close are lost. The slots of a worker share the writer, the blocks are handed to writer
+// when one is set.
+class ShardWriter {
+private:
+    int __models_fd__ = -1;
+    int __index_fd__ = -1;
+    std::string __models_path__;
+    std::string __models__;
+    std::string __index__;
+    uint64_t __offset__ = 0; // of the end of __models__ in the shard
+    std::mutex __mutex__;
+    AsyncWriter *__writer__ = nullptr;
+
+    void write(int fd, std::string &buffer);
+public:
+    ShardWriter() = default;
+    ~ShardWriter();
+    ShardWriter(const ShardWriter&) = delete;
+    ShardWriter& operator=(const ShardWriter&) = delete;
+
+    // Opens <dir>/<name>.shard.pdbqt and its index for appending
+    void open(const std::string &dir, const std::string &name);
+    void set_writer(AsyncWriter *writer);
+    void close();
+    bool is_open() const;
+
+    void append(const std::string &ligand, const std::string &models, double best_energy);
+    void flush();
+};
+
+// The ligands with models in the shards of dir
+std::unordered_set <std::string> shard_ligands(const std::string &dir);
+// Merges the shard indexes of dir into a table "<ligand>\t<best affinity>\t<shard>\t<offset>\t<length>",
+// best affinity first, returns the number of ligands
+size_t merge_shard_indexes(const std::string &dir, const std::string &table_path);
+}
+#endif
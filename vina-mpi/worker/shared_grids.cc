@@ -0,0 +1,126 @@
+//============================================================================
+// Name        : shared_grids.cc
+// Author      : Fabian Mora
+// Version     : 1.0
+// License     : MIT license
+// Description :
+//============================================================================
+
+#include <algorithm>
+#include "shared_grids.hh"
+#include "../util/mpi.hh"
+
+namespace MPIBatch {
+SharedGrids::SharedGrids() {
+}
+
+SharedGrids::~SharedGrids() {
+    clear();
+}
+
+void SharedGrids::clear() {
+    if (window != MPI_WIN_NULL) {
+        if (lockedQ)
+            MPI_Win_unlock_all(window);
+        MPI_Win_free(&window);
+    }
+    if (node_communicator != MPI_COMM_NULL)
+        MPI_Comm_free(&node_communicator);
+    window = MPI_WIN_NULL;
+    node_communicator = MPI_COMM_NULL;
+    node_rank = -1;
+    node_size = 0;
+    lockedQ = false;
+    sharedQ = false;
+    __logger__ = nullptr;
+}
+
+void SharedGrids::init(Logger &logger, MPI_Comm communicator, bool participateQ) {
+    clear();
+    __logger__ = &logger;
+    int rank;
+    mpi_error <true>(logger, MPI_Comm_rank(communicator, &rank));
+    mpi_error <true>(logger,
+            MPI_Comm_split_type(communicator, participateQ ? MPI_COMM_TYPE_SHARED : MPI_UNDEFINED, rank,
+                    MPI_INFO_NULL, &node_communicator));
+    if (node_communicator != MPI_COMM_NULL) {
+        mpi_error <true>(logger, MPI_Comm_rank(node_communicator, &node_rank));
+        mpi_error <true>(logger, MPI_Comm_size(node_communicator, &node_size));
+    }
+}
+
+bool SharedGrids::share(__vina__::vina_session_t &session, int cpu) {
+    if (node_communicator == MPI_COMM_NULL || __logger__ == nullptr)
+        return false;
+    Logger &logger = *__logger__;
+    int status = 1;
+    MPI_Aint size = 0;
+    if (leaderQ()) {
+        try {
+            size = session.grid_storage_size();
+            if (session.mapped_grids())
+                status = 2;
+        } catch (...) {
+            status = 0;
+        }
+    }
+    mpi_error <true>(logger, MPI_Bcast(&status, 1, MPI_INT, 0, node_communicator));
+    if (status == 2) {
+        if (leaderQ())
+            logger(LogType::info, "Grid maps are memory-mapped, the page cache already shares them");
+        return false;
+    }
+    if (status == 0) {
+        logger(LogType::warn, "Couldn't set up the scoring function, grid maps won't be shared");
+        return false;
+    }
+    void *storage = nullptr;
+    mpi_error <true>(logger,
+            MPI_Win_allocate_shared(size, 1, MPI_INFO_NULL, node_communicator,
+                    reinterpret_cast <void*>(&storage), &window));
+    mpi_error <true>(logger, MPI_Win_lock_all(MPI_MODE_NOCHECK, window));
+    lockedQ = true;
+    if (leaderQ()) {
+        try {
+            session.share_grids(storage, std::max(cpu, 1) * node_size);
+        } catch (std::exception &exc) {
+            logger(LogType::error, "Populating the shared grid maps failed, error message: ", exc.what());
+            status = 0;
+        } catch (...) {
+            logger(LogType::error, "Populating the shared grid maps failed");
+            status = 0;
+        }
+    }
+    mpi_error <true>(logger, MPI_Win_sync(window));
+    mpi_error <true>(logger, MPI_Bcast(&status, 1, MPI_INT, 0, node_communicator));
+    mpi_error <true>(logger, MPI_Win_sync(window));
+    if (status == 0 || session.empty())
+        return false;
+    if (!leaderQ()) {
+        int disp_unit;
+        mpi_error <true>(logger,
+                MPI_Win_shared_query(window, 0, &size, &disp_unit, reinterpret_cast <void*>(&storage)));
+        session.attach_grids(storage);
+    } else
+        logger(LogType::info, "Grid maps shared by ", node_size, " workers, size: ",
+                size / (1024. * 1024.), " MiB");
+    sharedQ = true;
+    return true;
+}
+
+bool SharedGrids::leaderQ() const {
+    return node_rank == 0;
+}
+
+bool SharedGrids::shared() const {
+    return sharedQ;
+}
+
+int SharedGrids::rank() const {
+    return node_rank;
+}
+
+int SharedGrids::size() const {
+    return node_size;
+}
+}
@@ -0,0 +1,50 @@
+//============================================================================
+// Name        : shared_grids.hh
+// Author      : Fabian Mora
+// Version     : 1.0
+// License     : MIT license
+// Description :
+//============================================================================
+
+#ifndef __SHARED_GRIDS_HH__
+#define __SHARED_GRIDS_HH__
+
+#include <mpi.h>
+
+#include "vina.hh"
+#include "../definitions.hh"
+#include "../io/logger.hh"
+
+namespace MPIBatch {
+class SharedGrids {
+private:
+    MPI_Comm node_communicator = MPI_COMM_NULL;
+    MPI_Win window = MPI_WIN_NULL;
+    int node_rank = -1;
+    int node_size = 0;
+    bool lockedQ = false;
+    bool sharedQ = false;
+    Logger *__logger__ = nullptr;
+    void clear();
+public:
+    SharedGrids();
+    ~SharedGrids();
+    SharedGrids(const SharedGrids&) = delete;
+    SharedGrids(SharedGrids&&) = delete;
+    SharedGrids& operator=(const SharedGrids&) = delete;
+    SharedGrids& operator=(SharedGrids&&) = delete;
+
+    // Collective over communicator, processes not participating (the master) only take part in the split
+    void init(Logger &logger, MPI_Comm communicator, bool participateQ);
+    // Collective over the node, the lowest rank populates the grid maps into a shared window and
+    // the rest of the node attaches to them, returns false if the maps couldn't be shared. The leader
+    // builds the maps with cpu threads per node process, as the rest of the node is waiting for it
+    bool share(__vina__::vina_session_t &session, int cpu = 1);
+
+    bool leaderQ() const;
+    bool shared() const;
+    int rank() const;
+    int size() const;
+};
+}
+#endif
@@ -9,6 +9,7 @@
 #ifndef __TASK_CONTAINER_HH__
 #define __TASK_CONTAINER_HH__
 
+#include <atomic>
 #include <functional>
 #include <future>
 #include <type_traits>
@@ -19,7 +20,9 @@ template <typename function_t>
 struct task_container {
     using return_t = typename std::function <function_t>::result_type;
     std::function <function_t> task;
+    std::function <void()> notify = std::function <void()>(); // called by the task's thread once it returns
     std::future <return_t> task_instance;
+    std::atomic <bool> returned = false;
 
     ~task_container() {
     }
@@ -27,17 +30,41 @@ struct task_container {
     template <typename ...Args>
     void run(Args &&... args) {
         if(task) {
-            task_instance = std::async(std::launch::async, task, args...);
+            returned = false;
+            task_instance = std::async(std::launch::async, [this](std::decay_t <Args> ... args) {
+                finish_signal signal(*this);
+                return task(args...);
+            }, std::forward <Args>(args)...);
         }
     }
 
-    bool finished() {
-        auto status = task_instance.wait_for(std::chrono::seconds(0));
-        if (status == std::future_status::timeout)
-            return false;
-        else
-            return true;
+    bool running() const {
+        return task_instance.valid();
     }
+
+    bool finished() const {
+        return running() && returned;
+    }
+
+    // Releases a finished task, rethrowing its exception if it threw one
+    return_t get() {
+        returned = false;
+        return task_instance.get();
+    }
+
+private:
+    // Flags the task as returned and notifies, also when it throws
+    struct finish_signal {
+        task_container &container;
+        finish_signal(task_container &container) :
+                container(container) {
+        }
+        ~finish_signal() {
+            container.returned = true;
+            if (container.notify)
+                container.notify();
+        }
+    };
 };
 }
 #endif
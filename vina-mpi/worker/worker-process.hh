@@ -11,9 +11,14 @@
 
 #include <algorithm>
 #include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
 #include <map>
+#include <mutex>
 #include <string>
 #include <thread>
+#include <type_traits>
 #include <mpi.h>
 
 #include "../definitions.hh"
@@ -21,13 +26,25 @@
 #include "../util/util.hh"
 #include "../util/mpi.hh"
 #include "../node.hh"
+#include "../serializers/result_serializer.hh"
 
 namespace MPIBatch {
 
+// The worker runs its tasks in slots, each with a local queue of up to worker_prefetch batches besides
+// the one it runs: a slot asks the master for its next batch while the current one runs, and launches
+// it as soon as the running task returns. The tasks signal the worker when they return.
+// The worker has one status exchange in flight at a time, it sends finished once per completed batch,
+// available when a slot has room for another batch, both naming the slot, and running as a keep alive;
+// the master replies with available followed by the batch for that slot, wait, running or killed.
+// A finished status is preceded by the results of the batch, the task_result_t vector the task returned
+// (none for tasks returning void), which the master receives before replying. The bound of every reply
+// is passed to the bound observer.
 template <ServerMode mode>
 class WorkerProcess {
 public:
     using node_t = Node<std::pair<void*, int64_t>>;
+    // Called with the bound of every status reply of the master
+    using bound_observer_t = std::function <void(int)>;
 private:
     // MPI information
     int rank = -1;
@@ -35,20 +52,34 @@ private:
     std::string hostname = "";
     MPI_Comm communicator = MPI_COMM_NULL;
 
+    // A task container with the batches queued for it
+    template <typename Task, typename data_t>
+    struct slot_t {
+        Task task;
+        std::deque <std::vector <data_t>> local_queue;
+        std::deque <std::string> unreported; // the packed results of the finished batches not reported yet
+    };
+
     // Internal data & methods
     node_t node = node_t();
     time_point master_last_ping = time_point();
     Logger __logger__;
+    std::mutex signal_mutex;
+    std::condition_variable signal;
+    size_t signals = 0;
+    std::string results_buffer; // sent through node.send_data
+    bound_observer_t bound_observer = bound_observer_t();
 
     void init_channels();
-    bool send_status(duration timeout, duration sleep);
-    bool recv_status(duration timeout, duration sleep);
-    template <typename data_t>
-    bool recv_data(std::vector <data_t> &buffer, int size, MPI_Datatype type, int source,
-            duration timeout, duration sleep);
-    template <typename Serializer, typename Task, typename data_t>
-    bool full_cycle(Serializer &serializer, Task &task, std::vector <data_t> &buffer,
-            time_point &last_ping, time_point &last_task_ping, duration timeout, duration sleep);
+    void send_status(WorkerStatus status, int slot);
+    void send_results(std::string &&results);
+    bool recv_status();
+    template <typename Serializer, typename data_t>
+    bool recv_data(Serializer &serializer, std::deque <std::vector <data_t>> &local_queue);
+    template <typename Task>
+    std::string release_task(Task &task);
+    void notify();
+    void wait(duration timeout, size_t &seen);
 public:
     WorkerProcess(std::string log_path = "", MPI_Comm communicator = MPI_COMM_WORLD);
     ~WorkerProcess();
@@ -58,9 +89,10 @@ public:
     WorkerProcess& operator=(const WorkerProcess &other) = delete;
 
     Logger& logger();
+    void set_bound_observer(const bound_observer_t &observer);
 
     template <typename Serializer, typename Task>
-    int run(Serializer &serializer, Task &task);
+    int run(Serializer &serializer, Task &task, int slots = 1);
 };
 
 template <ServerMode mode>
@@ -108,177 +140,215 @@ inline Logger& WorkerProcess <mode>::logger() {
     return __logger__;
 }
 
+template <ServerMode mode>
+inline void WorkerProcess <mode>::set_bound_observer(const bound_observer_t &observer) {
+    bound_observer = observer;
+}
+
 template <ServerMode mode>
 inline void WorkerProcess <mode>::init_channels() {
     MPI_Request *request = &(node.send_status);
     mpi_error <true>(__logger__,
-            MPI_Send_init(node.status_buffer_addr(), 1, MPI_INT, 0, node_t::w2m_status_tag,
+            MPI_Send_init(node.status_buffer_addr(), node_t::status_count, MPI_INT, 0, node_t::w2m_status_tag,
                     communicator, request));
     node.send_status_s = RequestStatus::active;
     request = &(node.recv_status);
     mpi_error <true>(__logger__,
-            MPI_Recv_init(node.status_addr(), 1, MPI_INT, 0, node_t::m2w_status_tag, communicator,
+            MPI_Recv_init(node.status_addr(), node_t::status_count, MPI_INT, 0, node_t::m2w_status_tag, communicator,
                     request));
     node.recv_status_s = RequestStatus::active;
     node.state = NodeState::ready;
 }
 
+// Sends the status and posts the receive for the master's reply
 template <ServerMode mode>
-inline bool WorkerProcess <mode>::send_status(duration timeout, duration sleep) {
-    MPI_Request *request = &(node.send_status);
-    node.state = NodeState::sending_status;
-    if (node.send_status_s == RequestStatus::active) {
-        node.sync();
-        mpi_error <true>(__logger__, MPI_Start(request));
-        node.send_status_s = RequestStatus::started;
-    }
-    if (node.send_status_s == RequestStatus::started) {
-        bool result = try_request(__logger__, request, timeout, sleep);
-        if (result) {
-            node.send_status_s = RequestStatus::active;
-            node.state = NodeState::sending_status_complete;
-        }
-        return result;
-    }
-    return false;
+inline void WorkerProcess <mode>::send_status(WorkerStatus status, int slot) {
+    node.status = status;
+    node.slot = slot;
+    node.sync();
+    mpi_error <true>(__logger__, MPI_Start(&(node.send_status)));
+    node.send_status_s = RequestStatus::started;
+    mpi_error <true>(__logger__, MPI_Start(&(node.recv_status)));
+    node.recv_status_s = RequestStatus::started;
+    node.state = NodeState::receiving_status;
 }
 
+// Nonblocking, so that a large message doesn't wait for the master to post its receive
 template <ServerMode mode>
-inline bool WorkerProcess <mode>::recv_status(duration timeout, duration sleep) {
-    MPI_Request *request = &(node.recv_status);
-    node.state = NodeState::receiving_status;
-    if (node.recv_status_s == RequestStatus::active) {
-        mpi_error <true>(__logger__, MPI_Start(request));
-        node.recv_status_s = RequestStatus::started;
-    }
-    if (node.recv_status_s == RequestStatus::started) {
-        bool result = try_request(__logger__, request, timeout, sleep);
-        if (result) {
-            node.recv_status_s = RequestStatus::active;
-            node.state = NodeState::receiving_status_complete;
-        }
-        return result;
+inline void WorkerProcess <mode>::send_results(std::string &&results) {
+    if (node.send_data_s == RequestStatus::nonblocking) {
+        mpi_error <true>(__logger__, MPI_Wait(&(node.send_data), MPI_STATUS_IGNORE));
+        node.send_data_s = RequestStatus::null;
     }
-    return false;
+    results_buffer = std::move(results);
+    mpi_error <true>(__logger__,
+            MPI_Isend(results_buffer.data(), static_cast <int>(results_buffer.size()), MPI_BYTE, 0,
+                    node_t::results_tag, communicator, &(node.send_data)));
+    node.send_data_s = RequestStatus::nonblocking;
 }
 
 template <ServerMode mode>
-template <typename data_t>
-bool WorkerProcess <mode>::recv_data(std::vector <data_t> &buffer, int size, MPI_Datatype type,
-        int source, duration timeout, duration sleep) {
-    MPI_Request *request = &(node.recv_data);
-    node.state = NodeState::receiving_data;
-    if (node.recv_data_s == RequestStatus::null) {
-        buffer.resize(size);
-        void *ptr = reinterpret_cast <void*>(buffer.data());
-        mpi_error <true>(__logger__,
-                MPI_Irecv(ptr, size, type, source, node_t::recv_data_tag, communicator, request));
-        node.recv_data_s = RequestStatus::nonblocking;
-    }
-    if (node.recv_data_s == RequestStatus::nonblocking) {
-        bool result = try_request(__logger__, request, timeout, sleep);
-        if (result) {
-            node.recv_data_s = RequestStatus::null;
-            node.recv_data = MPI_REQUEST_NULL;
-            node.state = NodeState::receiving_data_complete;
-        }
-        return result;
+inline bool WorkerProcess <mode>::recv_status() {
+    int flag = 0;
+    mpi_error <true>(__logger__, MPI_Test(&(node.recv_status), &flag, MPI_STATUS_IGNORE));
+    if (flag == 0)
+        return false;
+    node.recv_status_s = RequestStatus::active;
+    node.unpack();
+    if (bound_observer)
+        bound_observer(node.bound);
+    // The master got the status, and the results before it, before replying, so the sends are complete
+    mpi_error <true>(__logger__, MPI_Wait(&(node.send_status), MPI_STATUS_IGNORE));
+    node.send_status_s = RequestStatus::active;
+    if (node.send_data_s == RequestStatus::nonblocking) {
+        mpi_error <true>(__logger__, MPI_Wait(&(node.send_data), MPI_STATUS_IGNORE));
+        node.send_data_s = RequestStatus::null;
     }
-    return false;
+    node.state = NodeState::receiving_status_complete;
+    return true;
 }
 
+// The batch follows an available reply, it is queued once it has arrived
 template <ServerMode mode>
-template <typename Serializer, typename Task, typename data_t>
-bool WorkerProcess <mode>::full_cycle(Serializer &serializer, Task &task,
-        std::vector <data_t> &buffer, time_point &last_ping, time_point &last_task_ping,
-        duration timeout, duration sleep) {
-    MPI_Status mpi_status;
-    bool modified_clock = false;
-    if (node.state == NodeState::ready || node.state == NodeState::sending_status) {
-        if (elapsed(now(), last_task_ping) >= task_status_cycle) {
-            if (node.status == WorkerStatus::running) {
-                if (task.finished()) {
-                    node.status = WorkerStatus::finished;
-                    if (task.task_instance.valid()) {
-                        try {
-                            task.task_instance.get();
-                        } catch (std::exception &exc) {
-                            __logger__(LogType::warn, "Worker ", rank,
-                                    " has experienced an exception message: ", exc.what());
-                        }
-                    }
-                }
-            }
-            last_task_ping = now();
-        }
-        send_status(timeout, sleep);
-    }
-    if (node.state == NodeState::sending_status_complete
-            || node.state == NodeState::receiving_status) {
-        auto [err, incomingQ] = iprobe(__logger__, 0, node_t::m2w_status_tag, &mpi_status, communicator);
-        if (err == 0 && incomingQ) {
-            recv_status(timeout, sleep);
-            last_ping = now();
-            modified_clock = true;
-        }
-    }
-    if (node.state == NodeState::receiving_status_complete) {
-        if (!active_worker_statusQ(node.status)) {
-            node.state = NodeState::terminated;
-        }
-        if (node.status == WorkerStatus::available) {
-            auto [err, incomingQ] = iprobe(__logger__, 0, node_t::recv_data_tag, &mpi_status,
-                    communicator);
-            if (err == 0 && incomingQ) {
-                int size;
-                mpi_error <true>(__logger__, MPI_Get_count(&mpi_status, serializer.mpi_type(), &size));
-                recv_data(buffer, size, serializer.mpi_type(), 0, timeout, sleep);
-                last_ping = now();
-                modified_clock = true;
-            }
-        } else if (node.status == WorkerStatus::running) {
-            node.state = NodeState::ready;
-            node.active_cycle = false;
-        }
+template <typename Serializer, typename data_t>
+bool WorkerProcess <mode>::recv_data(Serializer &serializer,
+        std::deque <std::vector <data_t>> &local_queue) {
+    MPI_Status mpi_status = MPI_Status();
+    auto [err, incomingQ] = iprobe(__logger__, 0, node_t::recv_data_tag, &mpi_status, communicator);
+    if (err != 0 || !incomingQ)
+        return false;
+    int size;
+    mpi_error <true>(__logger__, MPI_Get_count(&mpi_status, serializer.mpi_type(), &size));
+    std::vector <data_t> buffer(size);
+    mpi_error <true>(__logger__,
+            MPI_Recv(reinterpret_cast <void*>(buffer.data()), size, serializer.mpi_type(), 0,
+                    node_t::recv_data_tag, communicator, MPI_STATUS_IGNORE));
+    local_queue.push_back(std::move(buffer));
+    node.state = NodeState::receiving_data_complete;
+    return true;
+}
+
+// Returns the packed results of the task, none when it threw
+template <ServerMode mode>
+template <typename Task>
+inline std::string WorkerProcess <mode>::release_task(Task &task) {
+    try {
+        if constexpr (std::is_void_v <typename Task::return_t>)
+            task.get();
+        else
+            return ResultSerializer::pack(task.get());
+    } catch (std::exception &exc) {
+        __logger__(LogType::warn, "Worker ", rank, " has experienced an exception message: ",
+                exc.what());
     }
-    if (node.state == NodeState::receiving_data_complete)
-        node.state = NodeState::launch_task;
-    if (node.state == NodeState::launch_task) {
-        node.status = WorkerStatus::running;
-        task.run(std::ref(__logger__), serializer.deserialize(buffer), &(node.status));
-        node.state = NodeState::ready;
-        node.active_cycle = false;
+    return std::string();
+}
+
+template <ServerMode mode>
+inline void WorkerProcess <mode>::notify() {
+    {
+        std::lock_guard <std::mutex> lock(signal_mutex);
+        ++signals;
     }
-    return modified_clock;
+    signal.notify_one();
+}
+
+// Blocks until a task returns, if none did since seen, or the timeout expires
+template <ServerMode mode>
+inline void WorkerProcess <mode>::wait(duration timeout, size_t &seen) {
+    std::unique_lock <std::mutex> lock(signal_mutex);
+    signal.wait_for(lock, timeout, [this, &seen]() {
+        return signals != seen;
+    });
+    seen = signals;
 }
 
 template <ServerMode mode>
 template <typename Serializer, typename Task>
-inline int WorkerProcess <mode>::run(Serializer &serializer, Task &task) {
+inline int WorkerProcess <mode>::run(Serializer &serializer, Task &task, int slots) {
     bool ntimed_out = false;
-    time_point last_task_ping;
-    std::vector <typename Serializer::data_t> buffer;
-    __logger__(LogType::info, "Worker ", rank, " has started");
-    node.status = WorkerStatus::available;
+    size_t seen_signals = 0;
+    int receiving_slot = 0;
+    time_point next_request;
+    duration idle_sleep = duration(0);
+    std::vector <slot_t <Task, typename Serializer::data_t>> pool(std::max(slots, 1));
+    for (auto &slot : pool) {
+        slot.task.task = task.task;
+        slot.task.notify = [this]() {
+            notify();
+        };
+    }
+    __logger__(LogType::info, "Worker ", rank, " has started with ", pool.size(), " slot(s)");
     init_channels();
     master_last_ping = now();
-    last_task_ping = now();
+    next_request = now();
     while ((ntimed_out = (elapsed(now(), master_last_ping) <= worker_timeout))
-            && active_worker_statusQ(node.status)) {
-        time_point start = now();
-        if (node.active_cycle == false && active_worker_statusQ(node.status))
-            node.active_cycle = true;
-        if (node.active_cycle) {
-            if (!full_cycle(serializer, task, buffer, master_last_ping, last_task_ping,
-                    cycle_timeout, small_sleep))
-                master_last_ping += now() - start;
+            && node.state != NodeState::terminated) {
+        bool progressQ = false;
+        for (auto &slot : pool) {
+            if (slot.task.finished()) {
+                slot.unreported.push_back(release_task(slot.task));
+                progressQ = true;
+            }
+            if (!slot.task.running() && !slot.local_queue.empty()) {
+                slot.task.run(std::ref(__logger__), serializer.deserialize(slot.local_queue.front()));
+                slot.local_queue.pop_front();
+                progressQ = true;
+            }
+        }
+        if (node.state == NodeState::ready) {
+            auto reportQ = [](const auto &slot) {
+                return !slot.unreported.empty();
+            };
+            auto roomQ = [](const auto &slot) {
+                return slot.local_queue.size() + (slot.task.running() ? 1 : 0) <= worker_prefetch;
+            };
+            auto report = std::find_if(pool.begin(), pool.end(), reportQ);
+            auto room = std::find_if(pool.begin(), pool.end(), roomQ);
+            if (report != pool.end()) {
+                send_results(std::move(report->unreported.front()));
+                report->unreported.pop_front();
+                send_status(WorkerStatus::finished, static_cast <int>(report - pool.begin()));
+            } else if (room != pool.end() && now() >= next_request)
+                send_status(WorkerStatus::available, static_cast <int>(room - pool.begin()));
+            else if (elapsed(now(), master_last_ping) >= worker_ping_interval)
+                send_status(WorkerStatus::running, 0);
         }
-        if (node.status == WorkerStatus::available) {
-            std::this_thread::sleep_for(medium_sleep);
-        } else if (node.status == WorkerStatus::running) {
-            std::this_thread::sleep_for(large_sleep);
+        if (node.state == NodeState::receiving_status && recv_status()) {
+            master_last_ping = now();
+            progressQ = true;
+            switch (node.status) {
+            case WorkerStatus::available:
+                receiving_slot = std::clamp(node.slot, 0, static_cast <int>(pool.size()) - 1);
+                node.state = NodeState::receiving_data;
+                break;
+            case WorkerStatus::wait: // nothing to run for now, ask again later
+                next_request = now() + worker_ping_interval;
+                node.state = NodeState::ready;
+                break;
+            default:
+                node.state = active_worker_statusQ(node.status) ? NodeState::ready : NodeState::terminated;
+                break;
+            }
+        }
+        if (node.state == NodeState::receiving_data
+                && recv_data(serializer, pool[receiving_slot].local_queue)) {
+            node.state = NodeState::ready;
+            progressQ = true;
         }
+        // Short waits while a reply is due, long ones otherwise, both cut short when a task returns
+        if (progressQ)
+            idle_sleep = duration(0);
+        else if (node.state == NodeState::ready)
+            idle_sleep = large_sleep;
+        else
+            idle_sleep = std::clamp(idle_sleep * 2, duration(min_idle_sleep), duration(max_idle_sleep));
+        if (idle_sleep > duration(0))
+            wait(idle_sleep, seen_signals);
     }
+    for (auto &slot : pool) // only running when the master is gone
+        if (slot.task.running())
+            release_task(slot.task);
     if (!ntimed_out) {
         __logger__(LogType::warn, "Communication channel has timed out ",
                 static_cast <int>(node.status));